@@ -0,0 +1,404 @@
+/// Copyright (c) 2023 Samir Bioud
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+/// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+/// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+/// OR OTHER DEALINGS IN THE SOFTWARE.
+///
+
+
+//
+// Construction scalability harness
+//
+// Builds machines from pattern sets of growing size with each of the builder
+// primitives, then optimizes them. Every case runs within its own forked process,
+// so that the reported peak RSS belongs to that case alone, and so that a
+// pathological case can be killed once it exceeds the timeout.
+//
+// Results are written to stdout as JSON. When a baseline (a previous output of this
+// harness) is supplied, the process exits with a non-zero status if any case
+// regressed, which allows it to be used as a regression gate.
+//
+// usage: builder_bench [--max-size N] [--max-depth N] [--timeout SECONDS]
+//                      [--baseline FILE] [--tolerance FACTOR]
+//
+
+#include "./corpus.h"
+#include "regex-backend/state_machine.h"
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <poll.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace regex_backend;
+
+namespace {
+
+using Machine = StateMachine<void, char>;
+using Clock   = std::chrono::steady_clock;
+
+///
+/// Measurements taken within the child process, sent back to the parent over a pipe
+///
+struct Measurement {
+  double build_ms;
+  double optimize_ms;
+  std::size_t node_count;
+  char slowest_pass[32]; // the optimize() pass which took the longest
+  double slowest_pass_ms;
+  double slowest_pass_share; // slowest_pass_ms as a fraction of optimize_ms
+};
+
+struct CaseResult {
+  std::string name;
+  std::string status; // "ok", "timeout" or "crash"
+  Measurement m;
+  long peak_rss_kb;
+};
+
+struct Case {
+  std::string name;
+  std::function<Machine()> build;
+};
+
+double ms_since(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+Machine digits() {
+  Machine d;
+  d.match_digit().exit_point().optimize();
+  return d;
+}
+
+///
+/// One case per builder primitive, for each pattern set size
+///
+void keyword_cases(std::vector<Case>& cases, std::size_t max_size) {
+  for (std::size_t n = 10; n <= max_size && n <= 100000; n *= 10) {
+    auto const suffix = "/" + std::to_string(n);
+
+    cases.push_back({"match_sequence" + suffix, [n]() {
+                       Machine m;
+                       for (auto const& kw : bench::generated_keywords(n)) {
+                         m.root().match_sequence(kw).exit_point();
+                       }
+                       return m;
+                     }});
+
+    cases.push_back({"match_any_of" + suffix, [n]() {
+                       Machine m;
+                       for (auto const& kw : bench::generated_keywords(n)) {
+                         m.root().match_sequence(kw).match_any_of("0123456789").exit_point();
+                       }
+                       return m;
+                     }});
+
+    cases.push_back({"match" + suffix, [n]() {
+                       Machine m;
+                       for (auto const& kw : bench::generated_keywords(n)) {
+                         Machine pattern;
+                         pattern.match_sequence(kw).exit_point();
+                         m.root().match(pattern).exit_point();
+                       }
+                       return m;
+                     }});
+
+    cases.push_back({"match_many_optionally" + suffix, [n]() {
+                       auto d = digits();
+                       Machine m;
+                       for (auto const& kw : bench::generated_keywords(n)) {
+                         m.root().match_sequence(kw).match_many_optionally(d).exit_point();
+                       }
+                       return m;
+                     }});
+  }
+}
+
+///
+/// Repetitions nested within repetitions, i.e. ( [ab] ( [ab] ( ... )* d )* e )*
+///
+/// each level closes with its own character, so that the loops do not collide with one another
+///
+void nested_cases(std::vector<Case>& cases, std::size_t max_depth) {
+  for (std::size_t depth = 1; depth <= max_depth; depth++) {
+    cases.push_back({"nested_repetition/" + std::to_string(depth), [depth]() {
+                       Machine inner;
+                       inner.match_sequence("c").exit_point();
+                       for (std::size_t d = 0; d < depth; d++) {
+                         Machine outer;
+                         outer.match_any_of("ab")
+                             .match_many_optionally(inner)
+                             .match_sequence(std::string(1, (char)('d' + d)))
+                             .exit_point();
+                         outer.optimize();
+                         inner = outer;
+                       }
+                       Machine m;
+                       m.match_many_optionally(inner).exit_point();
+                       return m;
+                     }});
+  }
+}
+
+///
+/// Long linear patterns, i.e. [0-9a-f]{n}, whose optimize() must stay close to linear in n
+///
+void repeat_cases(std::vector<Case>& cases, std::size_t max_size) {
+  for (std::size_t n = 128; n <= 1024 && n <= max_size; n *= 2) {
+    cases.push_back({"optimize_repeat/" + std::to_string(n), [n]() {
+                       Machine hex;
+                       hex.match_any_of("0123456789abcdef").exit_point().optimize();
+                       Machine m;
+                       m.match_repeat(hex, n).exit_point();
+                       return m;
+                     }});
+  }
+}
+
+///
+/// Runs the case in a forked child, killing it if it exceeds the timeout
+///
+CaseResult run_case(Case const& c, int timeout_s) {
+  CaseResult result;
+  result.name        = c.name;
+  result.m           = {};
+  result.peak_rss_kb = 0;
+
+  int fds[2];
+  if (pipe(fds) != 0) {
+    std::perror("pipe");
+    std::exit(2);
+  }
+
+  pid_t const pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    Measurement m{};
+
+    auto start      = Clock::now();
+    Machine machine = c.build();
+    m.build_ms      = ms_since(start);
+
+    machine.trace_optimize([&](OptimizePassTrace const& pass) {
+      double const ms = std::chrono::duration<double, std::milli>(pass.wall_time).count();
+      if (ms >= m.slowest_pass_ms) {
+        m.slowest_pass_ms = ms;
+        std::snprintf(m.slowest_pass, sizeof(m.slowest_pass), "%s", pass.pass);
+      }
+    });
+
+    start = Clock::now();
+    machine.optimize();
+    m.optimize_ms        = ms_since(start);
+    m.node_count         = machine.node_count();
+    m.slowest_pass_share = m.optimize_ms > 0 ? m.slowest_pass_ms / m.optimize_ms : 0;
+
+    auto written = write(fds[1], &m, sizeof(m));
+    _exit(written == sizeof(m) ? 0 : 1);
+  }
+  close(fds[1]);
+
+  pollfd pfd{fds[0], POLLIN, 0};
+  int const ready = poll(&pfd, 1, timeout_s * 1000);
+  bool received   = false;
+  if (ready > 0) {
+    received = read(fds[0], &result.m, sizeof(result.m)) == sizeof(result.m);
+  } else {
+    kill(pid, SIGKILL);
+  }
+  close(fds[0]);
+
+  int status = 0;
+  rusage usage{};
+  wait4(pid, &status, 0, &usage);
+  result.peak_rss_kb = usage.ru_maxrss;
+
+  if (ready == 0) {
+    result.status = "timeout";
+  } else if (!received || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    result.status = "crash";
+  } else {
+    result.status = "ok";
+  }
+  return result;
+}
+
+void print_json(std::vector<CaseResult> const& results) {
+  // each case is kept on a single line, which keeps the baseline parser trivial
+  std::printf("{\n  \"cases\": [\n");
+  for (std::size_t i = 0; i < results.size(); i++) {
+    auto const& r = results[i];
+    std::printf("    {\"name\": \"%s\", \"status\": \"%s\", \"wall_ms\": %.3f, \"build_ms\": %.3f, "
+                "\"optimize_ms\": %.3f, \"peak_rss_kb\": %ld, \"node_count\": %zu, \"slowest_pass\": \"%s\", "
+                "\"slowest_pass_ms\": %.3f, \"slowest_pass_share\": %.3f}%s\n",
+                r.name.c_str(),
+                r.status.c_str(),
+                r.m.build_ms + r.m.optimize_ms,
+                r.m.build_ms,
+                r.m.optimize_ms,
+                r.peak_rss_kb,
+                r.m.node_count,
+                r.m.slowest_pass,
+                r.m.slowest_pass_ms,
+                r.m.slowest_pass_share,
+                i + 1 == results.size() ? "" : ",");
+  }
+  std::printf("  ]\n}\n");
+}
+
+///
+/// Reads a numeric field from a single-line case object, as written by print_json
+///
+double json_field(std::string const& line, std::string const& field) {
+  auto const key = "\"" + field + "\": ";
+  auto const pos = line.find(key);
+  return pos == std::string::npos ? 0 : std::strtod(line.c_str() + pos + key.size(), nullptr);
+}
+
+std::string json_string_field(std::string const& line, std::string const& field) {
+  auto const key = "\"" + field + "\": \"";
+  auto const pos = line.find(key);
+  if (pos == std::string::npos) {
+    return "";
+  }
+  auto const begin = pos + key.size();
+  return line.substr(begin, line.find('"', begin) - begin);
+}
+
+///
+/// Compares the results against a baseline, printing any regressions to stderr
+///
+/// a case regresses when it no longer completes, when its wall time or peak RSS grows beyond
+/// the tolerance factor, or when the optimized node count changes
+///
+bool within_baseline(std::vector<CaseResult> const& results, std::string const& path, double tolerance) {
+  std::ifstream in(path);
+  if (!in) {
+    std::fprintf(stderr, "Could not open baseline file '%s'\n", path.c_str());
+    return false;
+  }
+
+  std::map<std::string, std::string> baseline;
+  for (std::string line; std::getline(in, line);) {
+    auto name = json_string_field(line, "name");
+    if (!name.empty()) {
+      baseline[name] = line;
+    }
+  }
+
+  // small absolute slack, so that sub-millisecond cases do not flap
+  constexpr double SLACK_MS = 5;
+
+  bool ok = true;
+  for (auto const& r : results) {
+    auto found = baseline.find(r.name);
+    if (found == baseline.end()) {
+      continue;
+    }
+    auto const& line = found->second;
+    if (json_string_field(line, "status") != "ok") {
+      continue;
+    }
+
+    auto const wall_ms = r.m.build_ms + r.m.optimize_ms;
+    if (r.status != "ok") {
+      std::fprintf(stderr, "REGRESSION %s: status is now '%s'\n", r.name.c_str(), r.status.c_str());
+      ok = false;
+      continue;
+    }
+    if (wall_ms > json_field(line, "wall_ms") * tolerance + SLACK_MS) {
+      std::fprintf(
+          stderr, "REGRESSION %s: wall time %.3fms (baseline %.3fms)\n", r.name.c_str(), wall_ms, json_field(line, "wall_ms"));
+      ok = false;
+    }
+    if (r.peak_rss_kb > json_field(line, "peak_rss_kb") * tolerance) {
+      std::fprintf(stderr,
+                   "REGRESSION %s: peak rss %ldkb (baseline %.0fkb)\n",
+                   r.name.c_str(),
+                   r.peak_rss_kb,
+                   json_field(line, "peak_rss_kb"));
+      ok = false;
+    }
+    if (r.m.node_count != (std::size_t)json_field(line, "node_count")) {
+      std::fprintf(stderr,
+                   "REGRESSION %s: node count %zu (baseline %.0f)\n",
+                   r.name.c_str(),
+                   r.m.node_count,
+                   json_field(line, "node_count"));
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::size_t max_size  = 100000;
+  std::size_t max_depth = 6;
+  int timeout_s         = 60;
+  double tolerance      = 1.5;
+  std::string baseline;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::fprintf(stderr, "Missing value for argument '%s'\n", arg.c_str());
+      return 2;
+    }
+    if (arg == "--max-size") {
+      max_size = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--max-depth") {
+      max_depth = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--timeout") {
+      timeout_s = std::atoi(argv[++i]);
+    } else if (arg == "--baseline") {
+      baseline = argv[++i];
+    } else if (arg == "--tolerance") {
+      tolerance = std::strtod(argv[++i], nullptr);
+    } else {
+      std::fprintf(stderr, "Unknown argument '%s'\n", arg.c_str());
+      return 2;
+    }
+  }
+
+  std::vector<Case> cases;
+  keyword_cases(cases, max_size);
+  nested_cases(cases, max_depth);
+  repeat_cases(cases, max_size);
+
+  std::vector<CaseResult> results;
+  for (auto const& c : cases) {
+    results.push_back(run_case(c, timeout_s));
+  }
+  print_json(results);
+
+  if (!baseline.empty() && !within_baseline(results, baseline, tolerance)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,239 @@
+/// Copyright (c) 2023 Samir Bioud
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+/// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+/// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+/// OR OTHER DEALINGS IN THE SOFTWARE.
+///
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ *
+ * Synthetic input corpora shared by every benchmark
+ *
+ * each generator is seeded with a fixed value, and only ever draws raw words
+ * from the engine (std::*_distribution output differs between standard libraries),
+ * so every run on every platform measures the exact same bytes
+ *
+ */
+namespace regex_backend::bench {
+
+constexpr std::uint32_t DEFAULT_SEED = 0x5eed;
+
+/**
+ * Deterministic source of randomness for corpus generation
+ */
+class CorpusRng {
+  std::mt19937 engine;
+
+public:
+  explicit CorpusRng(std::uint32_t seed = DEFAULT_SEED) : engine(seed) {
+  }
+
+  /**
+   * A value within [0, bound)
+   */
+  std::size_t below(std::size_t bound) {
+    return engine() % bound;
+  }
+
+  /**
+   * true roughly once in every 'n' calls
+   */
+  bool one_in(std::size_t n) {
+    return below(n) == 0;
+  }
+
+  template <typename T> T const& pick(std::vector<T> const& from) {
+    return from[below(from.size())];
+  }
+};
+
+/**
+ * A small fixed vocabulary of keywords, used both to build machines
+ * and to plant hits within the corpora
+ */
+inline std::vector<std::string> const& keywords() {
+  static std::vector<std::string> const kw = {
+      "alpha",  "bravo",   "charlie", "delta", "echo",   "foxtrot", "golf",    "hotel",   "india",  "juliett",
+      "kilo",   "lima",    "mike",    "oscar", "papa",   "quebec",  "romeo",   "sierra",  "tango",  "uniform",
+      "victor", "whiskey", "xray",    "yankee", "zulu",  "return",  "while",   "struct",  "static", "include"};
+  return kw;
+}
+
+/**
+ * Generate a set of 'count' distinct lowercase keywords
+ *
+ * the words share prefixes the same way real keyword lists do, which keeps the
+ * resulting machines representative of real rule sets
+ */
+inline std::vector<std::string> generated_keywords(std::size_t count, std::uint32_t seed = DEFAULT_SEED) {
+  CorpusRng rng(seed);
+  std::vector<std::string> words;
+  words.reserve(count);
+  for (std::size_t i = 0; i < count; i++) {
+    std::string w = keywords()[i % keywords().size()];
+    // a unique base-26 suffix guarantees distinctness
+    for (std::size_t n = i / keywords().size(); n != 0; n /= 26) {
+      w += (char)('a' + n % 26);
+    }
+    w += (char)('a' + rng.below(26));
+    words.push_back(w);
+  }
+  return words;
+}
+
+/**
+ * Generate 'count' random lowercase words of 5 to 12 letters
+ *
+ * unlike generated_keywords(), the words share little structure, so the machines built from them
+ * keep most of their states through optimize()
+ */
+inline std::vector<std::string> random_keywords(std::size_t count, std::uint32_t seed = DEFAULT_SEED) {
+  CorpusRng rng(seed);
+  std::vector<std::string> words(count);
+  for (auto& w : words) {
+    auto const len = 5 + rng.below(8);
+    for (std::size_t i = 0; i < len; i++) {
+      w += (char)('a' + rng.below(26));
+    }
+  }
+  return words;
+}
+
+/**
+ * Random lowercase words separated by single spaces
+ *
+ * roughly one word in 'hit_every' is replaced by one of the provided keywords
+ */
+inline std::string random_text(std::size_t bytes,
+                               std::vector<std::string> const& plant = keywords(),
+                               std::size_t hit_every                 = 16,
+                               std::uint32_t seed                    = DEFAULT_SEED) {
+  CorpusRng rng(seed);
+  std::string out;
+  out.reserve(bytes + 32);
+  while (out.size() < bytes) {
+    if (!plant.empty() && rng.one_in(hit_every)) {
+      out += rng.pick(plant);
+    } else {
+      auto const len = 2 + rng.below(8);
+      for (std::size_t i = 0; i < len; i++) {
+        out += (char)('a' + rng.below(26));
+      }
+    }
+    out += ' ';
+  }
+  out.resize(bytes);
+  return out;
+}
+
+/**
+ * Text resembling c-like source code, made of identifiers, integers, operators and line comments
+ */
+inline std::string source_code(std::size_t bytes, std::uint32_t seed = DEFAULT_SEED) {
+  static std::vector<std::string> const operators = {" = ", " + ", " - ", " * ", "; ", ", ", "(", ")", " { ", " }\n"};
+  CorpusRng rng(seed);
+  std::string out;
+  out.reserve(bytes + 64);
+  while (out.size() < bytes) {
+    switch (rng.below(8)) {
+      case 0: out += "// " + random_text(8 + rng.below(40), {}, 16, rng.below(1 << 16)) + "\n"; break;
+      case 1:
+      case 2: out += std::to_string(rng.below(100000)); break;
+      case 3: out += rng.pick(keywords()); break;
+      default: {
+        auto const len = 1 + rng.below(12);
+        out += (char)('a' + rng.below(26));
+        for (std::size_t i = 1; i < len; i++) {
+          auto const c = rng.below(38);
+          out += c < 26 ? (char)('a' + c) : c < 36 ? (char)('0' + c - 26) : '_';
+        }
+      }
+    }
+    out += rng.pick(operators);
+  }
+  out.resize(bytes);
+  return out;
+}
+
+/**
+ * Newline-separated lines resembling service logs, with timestamps, levels, ip addresses and durations
+ */
+inline std::string log_lines(std::size_t bytes, std::uint32_t seed = DEFAULT_SEED) {
+  static std::vector<std::string> const levels  = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+  static std::vector<std::string> const actions = {"GET", "POST", "PUT", "DELETE"};
+  CorpusRng rng(seed);
+  std::string out;
+  out.reserve(bytes + 256);
+  while (out.size() < bytes) {
+    out += "2023-" + std::to_string(10 + rng.below(3)) + "-" + std::to_string(10 + rng.below(18)) + "T" +
+           std::to_string(10 + rng.below(14)) + ":" + std::to_string(10 + rng.below(50)) + ":" +
+           std::to_string(10 + rng.below(50)) + "Z ";
+    out += rng.pick(levels) + " [worker-" + std::to_string(rng.below(16)) + "] ";
+    out += rng.pick(actions) + " /api/v" + std::to_string(1 + rng.below(3)) + "/" + rng.pick(keywords());
+    out += " from " + std::to_string(rng.below(256)) + "." + std::to_string(rng.below(256)) + "." +
+           std::to_string(rng.below(256)) + "." + std::to_string(rng.below(256));
+    out += " took " + std::to_string(rng.below(5000)) + "ms";
+    if (rng.one_in(8)) {
+      out += " error=\"" + random_text(10 + rng.below(30), {}, 16, rng.below(1 << 16)) + "\"";
+    }
+    out += "\n";
+  }
+  out.resize(bytes);
+  return out;
+}
+
+/**
+ * Mostly-ascii text interleaved with 2, 3 and 4 byte utf8 sequences
+ *
+ * the output is always valid utf8, truncation never splits a codepoint
+ */
+inline std::string utf8_text(std::size_t bytes,
+                             std::vector<std::string> const& plant = keywords(),
+                             std::uint32_t seed                    = DEFAULT_SEED) {
+  static std::vector<std::string> const wide = {"é", "ß", "λ", "ж", "€", "→", "中", "文", "😀", "🚀"};
+  CorpusRng rng(seed);
+  std::string out;
+  out.reserve(bytes + 32);
+  while (true) {
+    std::string word;
+    if (!plant.empty() && rng.one_in(16)) {
+      word = rng.pick(plant);
+    } else {
+      auto const len = 2 + rng.below(8);
+      for (std::size_t i = 0; i < len; i++) {
+        word += rng.one_in(4) ? rng.pick(wide) : std::string(1, (char)('a' + rng.below(26)));
+      }
+    }
+    word += ' ';
+    if (out.size() + word.size() > bytes) {
+      break;
+    }
+    out += word;
+  }
+  out.resize(bytes, ' ');
+  return out;
+}
+
+}; // namespace regex_backend::bench
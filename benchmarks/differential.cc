@@ -0,0 +1,468 @@
+/// Copyright (c) 2023 Samir Bioud
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+/// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+/// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+/// OR OTHER DEALINGS IN THE SOFTWARE.
+///
+
+
+//
+// Differential harness, comparing this library against std::regex and, when they are
+// available at configure time, RE2 and PCRE2
+//
+// Every case is a pattern written twice, once through the StateMachine builder and once
+// as a regular expression string, which is run over one of the synthetic corpora.
+// The string is also compiled by compile_regex(), and the time taken to compile it is
+// compared against std::regex.
+// The corpus is split into records (lines, or ~256 byte chunks for text without newlines),
+// and every engine collects every match within every record.
+//
+// Reports throughput over the whole corpus and the latency percentiles of a single record,
+// then checks that all engines found exactly the same match spans. The process exits
+// with a non-zero status if any engine disagrees.
+//
+// All patterns are chosen so that leftmost-first (backtracking) engines agree with the
+// leftmost-longest semantics of find(): alternations of literals are ordered longest first.
+//
+// usage: differential_bench [--size BYTES] [--passes N]
+//
+
+#include "./corpus.h"
+#include "regex-backend/parser.h"
+#include "regex-backend/state_machine.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <regex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef HAVE_RE2
+#  include <re2/re2.h>
+#endif
+
+#ifdef HAVE_PCRE2
+#  define PCRE2_CODE_UNIT_WIDTH 8
+#  include <pcre2.h>
+#endif
+
+using namespace regex_backend;
+
+namespace {
+
+using Machine = StateMachine<void, char>;
+using Clock   = std::chrono::steady_clock;
+
+struct Span {
+  std::size_t begin;
+  std::size_t end;
+
+  bool operator==(Span const&) const = default;
+};
+
+using FindAll = std::function<void(std::string_view record, std::vector<Span>& out)>;
+
+struct Engine {
+  std::string name;
+  FindAll find_all;
+};
+
+struct Case {
+  std::string name;
+  std::string corpus_name;
+  std::function<std::string(std::size_t)> corpus;
+  std::function<Machine()> machine;
+  std::string pattern;
+};
+
+std::string longest_first_alternation(std::vector<std::string> words) {
+  std::stable_sort(words.begin(), words.end(), [](auto const& a, auto const& b) {
+    return a.size() > b.size();
+  });
+  std::string out;
+  for (auto const& w : words) {
+    out += (out.empty() ? "" : "|") + w;
+  }
+  return out;
+}
+
+std::vector<Case> cases() {
+  std::vector<Case> c;
+
+  c.push_back({"keywords",
+               "random_text",
+               [](std::size_t n) {
+                 return bench::random_text(n);
+               },
+               []() {
+                 Machine m;
+                 for (auto const& kw : bench::keywords()) {
+                   m.root().match_sequence(kw).exit_point();
+                 }
+                 m.optimize();
+                 return m;
+               },
+               longest_first_alternation(bench::keywords())});
+
+  c.push_back({"integer",
+               "source_code",
+               [](std::size_t n) {
+                 return bench::source_code(n);
+               },
+               []() {
+                 Machine digit;
+                 digit.match_digit().exit_point().optimize();
+                 Machine m;
+                 m.match_any_of("123456789").match_many_optionally(digit).exit_point();
+                 m.root().match_any_of("0").exit_point();
+                 m.optimize();
+                 return m;
+               },
+               "[1-9][0-9]*|0"});
+
+  c.push_back({"identifier",
+               "source_code",
+               [](std::size_t n) {
+                 return bench::source_code(n);
+               },
+               []() {
+                 Machine first;
+                 first.match_alpha().exit_point().root().match_any_of("_").exit_point().optimize();
+                 Machine rest;
+                 rest.match(first).exit_point().root().match_digit().exit_point().optimize();
+                 Machine m;
+                 m.match(first).match_many_optionally(rest).exit_point();
+                 m.optimize();
+                 return m;
+               },
+               "[A-Za-z_][A-Za-z0-9_]*"});
+
+  c.push_back({"log_level",
+               "log_lines",
+               [](std::size_t n) {
+                 return bench::log_lines(n);
+               },
+               []() {
+                 Machine m;
+                 for (auto level : {"ERROR", "WARN", "INFO", "DEBUG"}) {
+                   m.root().match_sequence(level).exit_point();
+                 }
+                 m.optimize();
+                 return m;
+               },
+               "ERROR|DEBUG|WARN|INFO"});
+
+  c.push_back({"ipv4",
+               "log_lines",
+               [](std::size_t n) {
+                 return bench::log_lines(n);
+               },
+               []() {
+                 Machine digit;
+                 digit.match_digit().exit_point().optimize();
+                 Machine m;
+                 m.match_many(digit).match_sequence(".").match_many(digit).match_sequence(".");
+                 m.match_many(digit).match_sequence(".").match_many(digit).exit_point();
+                 m.optimize();
+                 return m;
+               },
+               "[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+"});
+
+  return c;
+}
+
+Engine state_machine_engine(std::string name, Machine const& machine) {
+  return {name, [&machine](std::string_view record, std::vector<Span>& out) {
+            auto const base = const_cast<char*>(record.data());
+            std::span<char> rest(base, record.size());
+            while (!rest.empty()) {
+              auto result = machine.find(rest);
+              if (result.range.empty()) {
+                break;
+              }
+              out.push_back({(std::size_t)(result.range.data() - base),
+                             (std::size_t)(result.range.data() + result.range.size() - base)});
+              rest = {result.range.data() + result.range.size(), rest.data() + rest.size()};
+            }
+          }};
+}
+
+Engine std_regex_engine(std::regex const& re) {
+  return {"std::regex", [&re](std::string_view record, std::vector<Span>& out) {
+            for (std::cregex_iterator it(record.data(), record.data() + record.size(), re), end; it != end; ++it) {
+              auto const begin = (std::size_t)it->position();
+              out.push_back({begin, begin + (std::size_t)it->length()});
+            }
+          }};
+}
+
+#ifdef HAVE_RE2
+Engine re2_engine(re2::RE2 const& re) {
+  return {"re2", [&re](std::string_view record, std::vector<Span>& out) {
+            re2::StringPiece text(record.data(), record.size());
+            re2::StringPiece match;
+            std::size_t pos = 0;
+            while (pos < record.size() && re.Match(text, pos, record.size(), re2::RE2::UNANCHORED, &match, 1)) {
+              auto const begin = (std::size_t)(match.data() - record.data());
+              out.push_back({begin, begin + match.size()});
+              pos = begin + std::max<std::size_t>(match.size(), 1);
+            }
+          }};
+}
+#endif
+
+#ifdef HAVE_PCRE2
+struct Pcre2Pattern {
+  pcre2_code* code;
+  pcre2_match_data* data;
+
+  explicit Pcre2Pattern(std::string const& pattern) {
+    int error;
+    PCRE2_SIZE offset;
+    code = pcre2_compile((PCRE2_SPTR)pattern.c_str(), pattern.size(), 0, &error, &offset, nullptr);
+    if (code == nullptr) {
+      std::fprintf(stderr, "PCRE2 failed to compile '%s' (error %d at %zu)\n", pattern.c_str(), error, offset);
+      std::exit(2);
+    }
+    pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+    data = pcre2_match_data_create_from_pattern(code, nullptr);
+  }
+
+  ~Pcre2Pattern() {
+    pcre2_match_data_free(data);
+    pcre2_code_free(code);
+  }
+};
+
+Engine pcre2_engine(Pcre2Pattern const& re) {
+  return {"pcre2", [&re](std::string_view record, std::vector<Span>& out) {
+            std::size_t pos = 0;
+            while (pos < record.size() &&
+                   pcre2_match(re.code, (PCRE2_SPTR)record.data(), record.size(), pos, 0, re.data, nullptr) > 0) {
+              auto const* ovector = pcre2_get_ovector_pointer(re.data);
+              out.push_back({ovector[0], ovector[1]});
+              pos = std::max(ovector[1], ovector[0] + 1);
+            }
+          }};
+}
+#endif
+
+std::vector<std::string_view> records(std::string const& corpus) {
+  constexpr std::size_t CHUNK = 256;
+  std::vector<std::string_view> out;
+  std::size_t begin = 0;
+  for (std::size_t i = 0; i < corpus.size(); i++) {
+    bool const split = corpus[i] == '\n' || (corpus[i] == ' ' && i - begin >= CHUNK);
+    if (split) {
+      out.emplace_back(corpus.data() + begin, i - begin);
+      begin = i + 1;
+    }
+  }
+  if (begin < corpus.size()) {
+    out.emplace_back(corpus.data() + begin, corpus.size() - begin);
+  }
+  return out;
+}
+
+struct Report {
+  double mb_per_s;
+  double p50_us;
+  double p90_us;
+  double p99_us;
+  double p999_us;
+  std::size_t matches;
+};
+
+///
+/// Runs the engine over each record, 'passes' times, keeping the matches of the final pass
+///
+Report measure(Engine const& engine,
+               std::vector<std::string_view> const& recs,
+               std::size_t passes,
+               std::vector<std::vector<Span>>& found) {
+  std::vector<double> latencies;
+  latencies.reserve(recs.size() * passes);
+  std::size_t bytes = 0;
+  double total_s    = 0;
+
+  for (std::size_t pass = 0; pass < passes; pass++) {
+    found.assign(recs.size(), {});
+    for (std::size_t r = 0; r < recs.size(); r++) {
+      auto const start = Clock::now();
+      engine.find_all(recs[r], found[r]);
+      auto const elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+      latencies.push_back(elapsed * 1e6);
+      total_s += elapsed;
+      bytes += recs[r].size();
+    }
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return latencies[std::min(latencies.size() - 1, (std::size_t)(p * latencies.size()))];
+  };
+
+  Report rep;
+  rep.mb_per_s = bytes / total_s / (1024 * 1024);
+  rep.p50_us   = percentile(0.5);
+  rep.p90_us   = percentile(0.9);
+  rep.p99_us   = percentile(0.99);
+  rep.p999_us  = percentile(0.999);
+  rep.matches  = 0;
+  for (auto const& f : found) {
+    rep.matches += f.size();
+  }
+  return rep;
+}
+
+///
+/// Compares the matches of an engine against the reference engine, printing the first few differences
+///
+std::size_t mismatches(std::string const& case_name,
+                       std::string const& engine,
+                       std::vector<std::string_view> const& recs,
+                       std::vector<std::vector<Span>> const& reference,
+                       std::vector<std::vector<Span>> const& found) {
+  constexpr std::size_t MAX_PRINTED = 3;
+  std::size_t count                 = 0;
+  for (std::size_t r = 0; r < recs.size(); r++) {
+    if (reference[r] == found[r]) {
+      continue;
+    }
+    if (count < MAX_PRINTED) {
+      std::fprintf(stderr,
+                   "MISMATCH [%s] %s found %zu matches where regex-backend found %zu, in record:\n    %.*s\n",
+                   case_name.c_str(),
+                   engine.c_str(),
+                   found[r].size(),
+                   reference[r].size(),
+                   (int)recs[r].size(),
+                   recs[r].data());
+    }
+    count++;
+  }
+  return count;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::size_t size   = 1 << 20;
+  std::size_t passes = 3;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::fprintf(stderr, "Missing value for argument '%s'\n", arg.c_str());
+      return 2;
+    }
+    if (arg == "--size") {
+      size = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--passes") {
+      passes = std::strtoull(argv[++i], nullptr, 10);
+    } else {
+      std::fprintf(stderr, "Unknown argument '%s'\n", arg.c_str());
+      return 2;
+    }
+  }
+
+  std::printf("%-12s %-12s %-14s %10s %9s %9s %9s %9s %9s\n",
+              "case",
+              "corpus",
+              "engine",
+              "MB/s",
+              "p50 us",
+              "p90 us",
+              "p99 us",
+              "p99.9 us",
+              "matches");
+
+  std::size_t total_mismatches = 0;
+  for (auto const& c : cases()) {
+    auto const corpus = c.corpus(size);
+    auto const recs   = records(corpus);
+
+    auto const machine = c.machine();
+
+    auto const parse_start = Clock::now();
+    auto const parsed      = compile_regex<Machine>(c.pattern);
+    auto const parse_us    = std::chrono::duration<double, std::micro>(Clock::now() - parse_start).count();
+    if (parsed.is_error()) {
+      std::fprintf(stderr,
+                   "compile_regex failed on '%s': %s (at %zu)\n",
+                   c.pattern.c_str(),
+                   parsed.error_message(),
+                   parsed.error_offset());
+      return 2;
+    }
+
+    auto const std_start = Clock::now();
+    std::regex const std_re(c.pattern, std::regex::ECMAScript | std::regex::optimize);
+    auto const std_us = std::chrono::duration<double, std::micro>(Clock::now() - std_start).count();
+    std::printf("%-12s compile: compile_regex %.1f us, std::regex %.1f us\n", c.name.c_str(), parse_us, std_us);
+#ifdef HAVE_RE2
+    re2::RE2 const re2_re(c.pattern);
+#endif
+#ifdef HAVE_PCRE2
+    Pcre2Pattern const pcre2_re(c.pattern);
+#endif
+
+    // the first engine is the reference every other engine is checked against
+    std::vector<Engine> engines = {state_machine_engine("regex-backend", machine),
+                                   state_machine_engine("compile_regex", parsed.machine()),
+                                   std_regex_engine(std_re)};
+#ifdef HAVE_RE2
+    engines.push_back(re2_engine(re2_re));
+#endif
+#ifdef HAVE_PCRE2
+    engines.push_back(pcre2_engine(pcre2_re));
+#endif
+
+    std::vector<std::vector<Span>> reference;
+    for (std::size_t e = 0; e < engines.size(); e++) {
+      std::vector<std::vector<Span>> found;
+      auto const rep = measure(engines[e], recs, passes, found);
+      std::printf("%-12s %-12s %-14s %10.1f %9.2f %9.2f %9.2f %9.2f %9zu\n",
+                  c.name.c_str(),
+                  c.corpus_name.c_str(),
+                  engines[e].name.c_str(),
+                  rep.mb_per_s,
+                  rep.p50_us,
+                  rep.p90_us,
+                  rep.p99_us,
+                  rep.p999_us,
+                  rep.matches);
+
+      if (e == 0) {
+        reference = std::move(found);
+      } else {
+        total_mismatches += mismatches(c.name, engines[e].name, recs, reference, found);
+      }
+    }
+  }
+
+  if (total_mismatches) {
+    std::fprintf(stderr, "%zu records differed between engines\n", total_mismatches);
+    return 1;
+  }
+  std::printf("all engines agree\n");
+  return 0;
+}
@@ -0,0 +1,121 @@
+/// Copyright (c) 2023 Samir Bioud
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+/// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+/// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+/// OR OTHER DEALINGS IN THE SOFTWARE.
+///
+
+
+//
+// Effect of the state numbering on the cache behaviour of find_many()
+//
+// the same large keyword machine is laid out in creation, breadth first, depth first
+// and profile guided order, and scanned with hardware counters (see perf_counters.h) enabled.
+// The misses are reported per KiB of input, and are omitted where the host exposes no counters
+//
+
+#include "./corpus.h"
+#include "./perf_counters.h"
+#include "regex-backend/state_machine.h"
+#include <benchmark/benchmark.h>
+#include <span>
+#include <string>
+#include <vector>
+
+using namespace regex_backend;
+
+namespace {
+
+using Machine      = StateMachine<void, char>;
+using Instrumented = StateMachine<void, char, MatchErrorMode::Return, 0, MatchStats>;
+
+///
+/// Any negative layout is the profile guided one, which needs a training scan
+///
+constexpr int PROFILED = -1;
+
+template <typename M> M build_unordered(std::vector<std::string> const& words) {
+  M m;
+  for (auto const& w : words) {
+    m.root().match_sequence(w).exit_point();
+  }
+  m.optimize(StateOrder::Creation);
+  return m;
+}
+
+///
+/// The profile is collected on an instrumented copy, so the measured machine carries no counting overhead
+/// (creation order is deterministic, so both copies share their numbering)
+///
+Machine build(std::vector<std::string> const& words, int layout, std::string& training) {
+  Machine m = build_unordered<Machine>(words);
+  if (layout == PROFILED) {
+    Instrumented profiler = build_unordered<Instrumented>(words);
+    for (auto const& r : profiler.find_many(std::span<char>(training.data(), training.size()))) {
+      benchmark::DoNotOptimize(r);
+    }
+    m.relayout(profiler.stats());
+  } else {
+    m.relayout((StateOrder)layout);
+  }
+  return m;
+}
+
+void BM_layout(benchmark::State& state) {
+  auto const words  = bench::random_keywords(state.range(1));
+  std::string input = bench::random_text(1 << 20, words, 4);
+  // the profile is gathered on different text than is measured
+  std::string training = bench::random_text(1 << 18, words, 4, bench::DEFAULT_SEED + 1);
+  Machine machine      = build(words, state.range(0), training);
+
+  bench::PerfCounters counters({bench::cycles(), bench::l1d_read_misses(), bench::llc_misses()});
+
+  std::size_t found = 0;
+  counters.start();
+  for (auto _ : state) {
+    for (auto const& result : machine.find_many(std::span<char>(input.data(), input.size()))) {
+      benchmark::DoNotOptimize(result);
+      found++;
+    }
+  }
+  counters.stop();
+
+  auto const values = counters.read();
+  auto const kib    = (double)state.iterations() * input.size() / 1024;
+  for (std::size_t i = 0; i < values.size(); i++) {
+    if (values[i]) {
+      state.counters[counters.measured()[i].name + "/KiB"] = *values[i] / kib;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.counters["matches"] = benchmark::Counter(found, benchmark::Counter::kAvgIterations);
+  state.counters["nodes"]   = machine.node_count();
+}
+
+} // namespace
+
+BENCHMARK(BM_layout)
+    ->ArgNames({"layout", "words"})
+    ->ArgsProduct({{(int)StateOrder::Creation, (int)StateOrder::BreadthFirst, (int)StateOrder::DepthFirst, PROFILED},
+                   {100, 250}})
+    ->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+}
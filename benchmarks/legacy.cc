@@ -0,0 +1,133 @@
+/// Copyright (c) 2023 Samir Bioud
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+/// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+/// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+/// OR OTHER DEALINGS IN THE SOFTWARE.
+///
+
+
+//
+// Throughput of the legacy MutableStateMachine lookup functions
+//
+
+#include "./corpus.h"
+#include "regex-backend/builder.h"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+using namespace regex_backend;
+
+namespace {
+
+MutableRegex& keyword_regex() {
+  static MutableRegex regex = []() {
+    MutableRegex rg;
+    for (auto const& kw : bench::keywords()) {
+      rg.match_sequence(kw).terminal().goback();
+    }
+    rg.optimize();
+    return rg;
+  }();
+  return regex;
+}
+
+///
+/// find_first() restarts from every character of the input, so the corpus is kept free
+/// of planted keywords to measure the full worst-case scan
+///
+void BM_legacy_find_first(benchmark::State& state) {
+  auto& regex       = keyword_regex();
+  std::string input = bench::random_text(state.range(0), {});
+
+  for (auto _ : state) {
+    auto result = regex.find_first(input.c_str());
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+void BM_legacy_find_many(benchmark::State& state) {
+  auto& regex       = keyword_regex();
+  std::string input = bench::random_text(state.range(0));
+
+  for (auto _ : state) {
+    auto results = regex.find_many(input.c_str());
+    benchmark::DoNotOptimize(results);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+///
+/// lookup() is anchored at the start of the input, so it is run from the start of every word
+///
+void BM_legacy_lookup(benchmark::State& state) {
+  auto& regex       = keyword_regex();
+  std::string input = bench::random_text(state.range(0));
+
+  std::vector<char const*> words = {input.c_str()};
+  for (std::size_t i = 0; i < input.size(); i++) {
+    if (input[i] == ' ') {
+      words.push_back(input.c_str() + i + 1);
+    }
+  }
+
+  for (auto _ : state) {
+    for (auto word : words) {
+      auto result = regex.lookup(word);
+      benchmark::DoNotOptimize(result);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.SetItemsProcessed(state.iterations() * words.size());
+}
+
+void BM_legacy_matches(benchmark::State& state) {
+  auto& regex       = keyword_regex();
+  std::string input = bench::random_text(state.range(0));
+
+  std::vector<std::string_view> words;
+  std::size_t begin = 0;
+  for (std::size_t i = 0; i <= input.size(); i++) {
+    if (i == input.size() || input[i] == ' ') {
+      words.emplace_back(input.data() + begin, i - begin);
+      begin = i + 1;
+    }
+  }
+
+  for (auto _ : state) {
+    for (auto word : words) {
+      auto result = regex.matches(word);
+      benchmark::DoNotOptimize(result);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.SetItemsProcessed(state.iterations() * words.size());
+}
+
+} // namespace
+
+BENCHMARK(BM_legacy_find_first)->Range(1 << 10, 1 << 16);
+BENCHMARK(BM_legacy_find_many)->Range(1 << 10, 1 << 16);
+BENCHMARK(BM_legacy_lookup)->Range(1 << 12, 1 << 20);
+BENCHMARK(BM_legacy_matches)->Range(1 << 12, 1 << 20);
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+}
@@ -0,0 +1,194 @@
+/// Copyright (c) 2023 Samir Bioud
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+/// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+/// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+/// OR OTHER DEALINGS IN THE SOFTWARE.
+///
+
+//
+// Throughput of the StateMachine lookup functions (find, find_many, matches and split)
+// on both the char and char32_t (utf8) machines
+//
+
+#include "./corpus.h"
+#include "regex-backend/state_machine.h"
+#include <array>
+#include <benchmark/benchmark.h>
+#include <span>
+#include <string>
+#include <vector>
+
+using namespace regex_backend;
+
+namespace {
+
+template <typename Transition_T> using KeywordMachine = StateMachine<void, Transition_T>;
+
+template <typename Transition_T> KeywordMachine<Transition_T>& keyword_machine() {
+  static KeywordMachine<Transition_T> machine = []() {
+    KeywordMachine<Transition_T> m;
+    for (auto const& kw : bench::keywords()) {
+      m.root().match_sequence(kw).exit_point();
+    }
+    m.optimize();
+    return m;
+  }();
+  return machine;
+}
+
+///
+/// The char machine is fed ascii text, the utf8 machine gets multi-byte sequences mixed in
+///
+template <typename Transition_T>
+std::string corpus(std::size_t bytes, std::vector<std::string> const& plant = bench::keywords()) {
+  if constexpr (std::is_same_v<Transition_T, char32_t>) {
+    return bench::utf8_text(bytes, plant);
+  } else {
+    return bench::random_text(bytes, plant);
+  }
+}
+
+///
+/// find() stops at the first hit, so the corpus is left without planted keywords
+/// to measure a scan over the entire input
+///
+template <typename Transition_T> void BM_find(benchmark::State& state) {
+  auto& machine     = keyword_machine<Transition_T>();
+  std::string input = corpus<Transition_T>(state.range(0), {});
+
+  for (auto _ : state) {
+    auto result = machine.find(std::span<char>(input.data(), input.size()));
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+template <typename Transition_T> void BM_find_many(benchmark::State& state) {
+  auto& machine     = keyword_machine<Transition_T>();
+  std::string input = corpus<Transition_T>(state.range(0));
+
+  std::size_t found = 0;
+  for (auto _ : state) {
+    for (auto const& result : machine.find_many(std::span<char>(input.data(), input.size()))) {
+      benchmark::DoNotOptimize(result);
+      found++;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.counters["matches"] = benchmark::Counter(found, benchmark::Counter::kAvgIterations);
+}
+
+///
+/// Full-matches every space-separated word of the corpus against the machine,
+/// which is roughly how keyword lookup tables are used
+///
+template <typename Transition_T> void BM_matches(benchmark::State& state) {
+  auto& machine     = keyword_machine<Transition_T>();
+  std::string input = corpus<Transition_T>(state.range(0));
+
+  std::vector<std::span<char>> words;
+  std::size_t begin = 0;
+  for (std::size_t i = 0; i <= input.size(); i++) {
+    if (i == input.size() || input[i] == ' ') {
+      words.emplace_back(input.data() + begin, i - begin);
+      begin = i + 1;
+    }
+  }
+
+  for (auto _ : state) {
+    for (auto word : words) {
+      auto result = machine.matches(word);
+      benchmark::DoNotOptimize(result);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.SetItemsProcessed(state.iterations() * words.size());
+}
+
+///
+/// Splits log lines into fields, the delimiter machine having either a single leading byte or several of them
+///
+StateMachine<void, char> const& delimiter_machine(bool single_lead) {
+  static auto const machines = []() {
+    std::array<StateMachine<void, char>, 2> m;
+    m[0].root().match_sequence("\n").exit_point();
+    m[0].root().match_sequence("] ").exit_point();
+    m[1].root().match_sequence(" took ").exit_point();
+    m[1].root().match_sequence(" from ").exit_point();
+    for (auto& machine : m) {
+      machine.optimize();
+    }
+    return m;
+  }();
+  return machines[single_lead];
+}
+
+void BM_split(benchmark::State& state) {
+  auto const& machine = delimiter_machine(state.range(0));
+  std::string input   = bench::log_lines(1 << 20);
+
+  std::size_t fields = 0;
+  for (auto _ : state) {
+    for (auto field : machine.split(std::span<char>(input.data(), input.size()))) {
+      benchmark::DoNotOptimize(field);
+      fields++;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.counters["fields"] = benchmark::Counter(fields, benchmark::Counter::kAvgIterations);
+}
+
+///
+/// The same fields, cut between the results of find_many()
+///
+void BM_split_find_many(benchmark::State& state) {
+  auto const& machine = delimiter_machine(state.range(0));
+  std::string input   = bench::log_lines(1 << 20);
+
+  std::size_t fields = 0;
+  for (auto _ : state) {
+    char* begin = input.data();
+    for (auto const& delimiter : machine.find_many(std::span<char>(input.data(), input.size()))) {
+      auto field = std::span<char>(begin, delimiter.range.data());
+      benchmark::DoNotOptimize(field);
+      begin = delimiter.range.data() + delimiter.range.size();
+      fields++;
+    }
+    auto last = std::span<char>(begin, input.data() + input.size());
+    benchmark::DoNotOptimize(last);
+    fields++;
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.counters["fields"] = benchmark::Counter(fields, benchmark::Counter::kAvgIterations);
+}
+
+} // namespace
+
+BENCHMARK(BM_split)->ArgName("single_lead")->Arg(1)->Arg(0);
+BENCHMARK(BM_split_find_many)->ArgName("single_lead")->Arg(1)->Arg(0);
+BENCHMARK_TEMPLATE(BM_find, char)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_find, char32_t)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_find_many, char)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_find_many, char32_t)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_matches, char)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_matches, char32_t)->Range(1 << 12, 1 << 20);
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+}
@@ -0,0 +1,147 @@
+/// Copyright (c) 2023 Samir Bioud
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+/// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+/// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+/// OR OTHER DEALINGS IN THE SOFTWARE.
+///
+
+
+//
+// Construction cost of machines, and the time spent within optimize()
+//
+
+#include "./corpus.h"
+#include "regex-backend/builder.h"
+#include "regex-backend/state_machine.h"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+using namespace regex_backend;
+
+namespace {
+
+template <typename Transition_T> StateMachine<void, Transition_T> build_keywords(std::vector<std::string> const& kws) {
+  StateMachine<void, Transition_T> m;
+  for (auto const& kw : kws) {
+    m.root().match_sequence(kw).exit_point();
+  }
+  return m;
+}
+
+///
+/// A machine in the style of presets::simple_identifier, which exercises the loop
+/// handling of match_many_optionally
+///
+template <typename Transition_T> StateMachine<void, Transition_T> build_identifier() {
+  StateMachine<void, Transition_T> first_char;
+  first_char.match_alpha().exit_point().root().match_any_of("_").exit_point().optimize();
+
+  StateMachine<void, Transition_T> other_chars;
+  other_chars.match(first_char).exit_point().root().match_digit().exit_point().optimize();
+
+  StateMachine<void, Transition_T> m;
+  m.match(first_char).match_many_optionally(other_chars).exit_point();
+  return m;
+}
+
+///
+/// Builds the machine every iteration, only the optimize() call is timed
+///
+template <typename Transition_T> void BM_optimize_keywords(benchmark::State& state) {
+  auto kws = bench::generated_keywords(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto m = build_keywords<Transition_T>(kws);
+    state.ResumeTiming();
+
+    m.optimize();
+    benchmark::DoNotOptimize(m);
+  }
+  state.SetItemsProcessed(state.iterations() * kws.size());
+}
+
+template <typename Transition_T> void BM_build_keywords(benchmark::State& state) {
+  auto kws = bench::generated_keywords(state.range(0));
+  for (auto _ : state) {
+    auto m = build_keywords<Transition_T>(kws);
+    benchmark::DoNotOptimize(m);
+  }
+  state.SetItemsProcessed(state.iterations() * kws.size());
+}
+
+template <typename Transition_T> void BM_optimize_identifier(benchmark::State& state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto m = build_identifier<Transition_T>();
+    state.ResumeTiming();
+
+    m.optimize();
+    benchmark::DoNotOptimize(m);
+  }
+}
+
+///
+/// A long linear pattern, [0-9a-f]{n}, optimize() is expected to grow close to linearly with n
+///
+void BM_optimize_repeat(benchmark::State& state) {
+  StateMachine<void, char> hex;
+  hex.match_any_of("0123456789abcdef").exit_point().optimize();
+  for (auto _ : state) {
+    state.PauseTiming();
+    StateMachine<void, char> m;
+    m.match_repeat(hex, state.range(0)).exit_point();
+    state.ResumeTiming();
+
+    m.optimize();
+    benchmark::DoNotOptimize(m);
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BM_legacy_optimize_keywords(benchmark::State& state) {
+  auto kws = bench::generated_keywords(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    MutableRegex rg;
+    for (auto const& kw : kws) {
+      rg.match_sequence(kw).terminal().goback();
+    }
+    state.ResumeTiming();
+
+    rg.optimize();
+    benchmark::DoNotOptimize(rg);
+  }
+  state.SetItemsProcessed(state.iterations() * kws.size());
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_build_keywords, char)->RangeMultiplier(4)->Range(8, 128);
+BENCHMARK_TEMPLATE(BM_build_keywords, char32_t)->RangeMultiplier(4)->Range(8, 128);
+BENCHMARK_TEMPLATE(BM_optimize_keywords, char)->RangeMultiplier(4)->Range(8, 128)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_optimize_keywords, char32_t)->RangeMultiplier(4)->Range(8, 128)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_optimize_identifier, char)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_optimize_identifier, char32_t)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_optimize_repeat)->RangeMultiplier(2)->Range(128, 1024)->Unit(benchmark::kMillisecond)->Complexity();
+BENCHMARK(BM_legacy_optimize_keywords)->RangeMultiplier(4)->Range(8, 128)->Unit(benchmark::kMicrosecond);
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+}
@@ -0,0 +1,159 @@
+/// Copyright (c) 2023 Samir Bioud
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+/// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+/// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+/// OR OTHER DEALINGS IN THE SOFTWARE.
+///
+
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#  include <cstring>
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+/**
+ *
+ * Minimal hardware counter access through perf_event_open(2)
+ *
+ * counters which cannot be opened (non-linux hosts, restrictive perf_event_paranoid settings,
+ * virtual machines without a PMU) are reported as missing rather than failing the benchmark
+ *
+ */
+namespace regex_backend::bench {
+
+struct PerfEvent {
+  std::string name;
+  std::uint32_t type;
+  std::uint64_t config;
+};
+
+#ifdef __linux__
+inline PerfEvent cycles() {
+  return {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES};
+}
+
+inline PerfEvent instructions() {
+  return {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS};
+}
+
+inline PerfEvent l1d_read_misses() {
+  return {"L1d-misses",
+          PERF_TYPE_HW_CACHE,
+          PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+}
+
+inline PerfEvent llc_misses() {
+  return {"LLC-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES};
+}
+
+inline PerfEvent branch_misses() {
+  return {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES};
+}
+#endif
+
+/**
+ * A set of counters, measuring the calling thread between start() and stop()
+ */
+class PerfCounters {
+  std::vector<PerfEvent> events;
+  std::vector<int> fds;
+
+public:
+  explicit PerfCounters(std::vector<PerfEvent> evs) : events(std::move(evs)), fds(events.size(), -1) {
+#ifdef __linux__
+    for (std::size_t i = 0; i < events.size(); i++) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size           = sizeof(attr);
+      attr.type           = events[i].type;
+      attr.config         = events[i].config;
+      attr.disabled       = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv     = 1;
+      attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds[i]              = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+  }
+
+  PerfCounters(PerfCounters const&) = delete;
+
+  ~PerfCounters() {
+#ifdef __linux__
+    for (int fd : fds) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+#endif
+  }
+
+  std::vector<PerfEvent> const& measured() const {
+    return events;
+  }
+
+  void start() {
+#ifdef __linux__
+    for (int fd : fds) {
+      if (fd != -1) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+
+  void stop() {
+#ifdef __linux__
+    for (int fd : fds) {
+      if (fd != -1) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      }
+    }
+#endif
+  }
+
+  /**
+   * The count of each event since the last start(), scaled up if the kernel multiplexed it,
+   * or std::nullopt if the event is unavailable
+   */
+  std::vector<std::optional<double>> read() const {
+    std::vector<std::optional<double>> out(events.size());
+#ifdef __linux__
+    for (std::size_t i = 0; i < events.size(); i++) {
+      std::uint64_t buf[3];
+      if (fds[i] == -1 || ::read(fds[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0) {
+        continue;
+      }
+      out[i] = (double)buf[0] * ((double)buf[1] / (double)buf[2]);
+    }
+#endif
+    return out;
+  }
+};
+
+}; // namespace regex_backend::bench
@@ -0,0 +1,266 @@
+/// Copyright (c) 2023 Samir Bioud
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+/// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+/// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+/// OR OTHER DEALINGS IN THE SOFTWARE.
+///
+
+
+//
+// Hardware counter harness for the match loop (linux only)
+//
+// Runs find() over every record of a workload with each engine variant, wrapped in
+// perf_event_open counters, and prints per-byte metrics: wall time, cycles, instructions (and their ratio),
+// L1d read misses, LLC misses and branch misses. Counters the host does not expose are printed as '-'.
+//
+// usage: perf_harness [--size BYTES] [--passes N] [--workload NAME] [--variant NAME]
+//
+
+#include "./corpus.h"
+#include "./perf_counters.h"
+#include "regex-backend/bit_parallel.h"
+#include "regex-backend/lazy_state_machine.h"
+#include "regex-backend/state_machine.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#ifndef __linux__
+#  error "perf_harness reads its counters through perf_event_open, which only exists on linux"
+#endif
+
+using namespace regex_backend;
+
+namespace {
+
+///
+/// An engine variant, returns the number of matches found in the input
+///
+struct Variant {
+  std::string name;
+  std::function<std::size_t(std::string& input)> run;
+};
+
+struct Workload {
+  std::string name;
+  std::vector<std::string> words;
+  std::function<std::string(std::size_t)> corpus;
+};
+
+std::vector<Workload> workloads() {
+  return {
+      {"keywords",
+       bench::keywords(),
+       [](std::size_t n) {
+         return bench::random_text(n);
+       }},
+      {"many_keywords",
+       bench::random_keywords(150),
+       [](std::size_t n) {
+         return bench::random_text(n, bench::random_keywords(150), 4);
+       }},
+      {"utf8_keywords",
+       bench::keywords(),
+       [](std::size_t n) {
+         return bench::utf8_text(n);
+       }},
+  };
+}
+
+template <typename M> std::size_t count_finds(M& machine, std::string& input) {
+  std::size_t found = 0;
+  std::span<char> rest(input.data(), input.size());
+  while (!rest.empty()) {
+    auto result = machine.find(rest);
+    if (result.range.empty()) {
+      break;
+    }
+    found++;
+    rest = {result.range.data() + result.range.size(), rest.data() + rest.size()};
+  }
+  return found;
+}
+
+///
+/// One machine per word, for the engines which combine rules themselves
+///
+std::vector<StateMachine<void, char>> rules(std::vector<std::string> const& words) {
+  std::vector<StateMachine<void, char>> out;
+  for (auto const& w : words) {
+    StateMachine<void, char> m;
+    m.match_sequence(w).exit_point().optimize();
+    out.push_back(m);
+  }
+  return out;
+}
+
+template <typename M> M build(std::vector<std::string> const& words, StateOrder order) {
+  M m;
+  for (auto const& w : words) {
+    m.root().match_sequence(w).exit_point();
+  }
+  m.optimize(order);
+  return m;
+}
+
+///
+/// Every engine in the tree, more engines (and prefilters) register here as they are added
+///
+std::vector<Variant> variants(Workload const& w) {
+  using Table = StateMachine<void, char>;
+  using Utf8  = StateMachine<void, char32_t>;
+
+  auto creation    = std::make_shared<Table>(build<Table>(w.words, StateOrder::Creation));
+  auto depth_first = std::make_shared<Table>(build<Table>(w.words, StateOrder::DepthFirst));
+  auto breadth     = std::make_shared<Table>(build<Table>(w.words, StateOrder::BreadthFirst));
+  auto utf8        = std::make_shared<Utf8>(build<Utf8>(w.words, StateOrder::DepthFirst));
+  auto lazy        = std::make_shared<LazyStateMachine<>>(rules(w.words));
+
+  // the bit-parallel engine holds a single linear pattern, compared against a table built from the same word
+  auto single_table = std::make_shared<Table>(build<Table>({w.words.front()}, StateOrder::DepthFirst));
+  auto single_bits  = std::make_shared<LinearMachine>(LinearPattern().match_sequence(w.words.front()));
+
+  return {
+      {"table/creation",
+       [=](std::string& in) {
+         return count_finds(*creation, in);
+       }},
+      {"table/breadth_first",
+       [=](std::string& in) {
+         return count_finds(*breadth, in);
+       }},
+      {"table/depth_first",
+       [=](std::string& in) {
+         return count_finds(*depth_first, in);
+       }},
+      {"table/utf8",
+       [=](std::string& in) {
+         return count_finds(*utf8, in);
+       }},
+      {"lazy",
+       [=](std::string& in) {
+         return count_finds(*lazy, in);
+       }},
+      {"single/table",
+       [=](std::string& in) {
+         return count_finds(*single_table, in);
+       }},
+      {"single/bit_parallel",
+       [=](std::string& in) {
+         return count_finds(*single_bits, in);
+       }},
+  };
+}
+
+void print_metric(std::optional<double> v, double per) {
+  if (v) {
+    std::printf(" %12.3f", *v / per);
+  } else {
+    std::printf(" %12s", "-");
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::size_t size          = 1 << 22;
+  std::size_t passes        = 5;
+  char const* only_workload = nullptr;
+  char const* only_variant  = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    auto const arg      = std::string(argv[i]);
+    auto const has_next = i + 1 < argc;
+    if (arg == "--size" && has_next) {
+      size = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--passes" && has_next) {
+      passes = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--workload" && has_next) {
+      only_workload = argv[++i];
+    } else if (arg == "--variant" && has_next) {
+      only_variant = argv[++i];
+    } else {
+      std::fprintf(stderr, "usage: %s [--size BYTES] [--passes N] [--workload NAME] [--variant NAME]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  bench::PerfCounters counters({bench::cycles(),
+                                bench::instructions(),
+                                bench::l1d_read_misses(),
+                                bench::llc_misses(),
+                                bench::branch_misses()});
+
+  std::printf("%-16s %-22s %10s %12s %12s %12s %12s %12s %12s %10s\n",
+              "workload",
+              "variant",
+              "ns/B",
+              "cycles/B",
+              "instr/B",
+              "IPC",
+              "L1d-miss/KB",
+              "LLC-miss/KB",
+              "br-miss/KB",
+              "matches");
+
+  for (auto const& w : workloads()) {
+    if (only_workload && w.name != only_workload) {
+      continue;
+    }
+    std::string input = w.corpus(size);
+
+    for (auto const& v : variants(w)) {
+      if (only_variant && v.name != only_variant) {
+        continue;
+      }
+
+      // one untimed pass, so every variant starts with warm caches
+      std::size_t found = v.run(input);
+
+      auto const start = std::chrono::steady_clock::now();
+      counters.start();
+      for (std::size_t p = 0; p < passes; p++) {
+        found = v.run(input);
+      }
+      counters.stop();
+      std::chrono::duration<double, std::nano> const elapsed = std::chrono::steady_clock::now() - start;
+
+      auto const values  = counters.read();
+      double const bytes = (double)input.size() * passes;
+
+      std::printf("%-16s %-22s %10.3f", w.name.c_str(), v.name.c_str(), elapsed.count() / bytes);
+      print_metric(values[0], bytes);
+      print_metric(values[1], bytes);
+      if (values[0] && values[1]) {
+        std::printf(" %12.3f", *values[1] / *values[0]);
+      } else {
+        std::printf(" %12s", "-");
+      }
+      print_metric(values[2], bytes / 1024);
+      print_metric(values[3], bytes / 1024);
+      print_metric(values[4], bytes / 1024);
+      std::printf(" %10zu\n", found);
+    }
+  }
+}
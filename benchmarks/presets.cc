@@ -0,0 +1,98 @@
+/// Copyright (c) 2023 Samir Bioud
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+/// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+/// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+/// OR OTHER DEALINGS IN THE SOFTWARE.
+///
+
+
+//
+// Throughput of every preset regular expression over synthetic source code
+//
+
+#include "./corpus.h"
+#include "regex-backend/presets.h"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace regex_backend;
+
+namespace {
+
+///
+/// Splits the source corpus into whitespace / operator separated tokens
+///
+std::vector<std::string_view> tokens(std::string const& input) {
+  std::vector<std::string_view> out;
+  std::size_t begin = 0;
+  for (std::size_t i = 0; i <= input.size(); i++) {
+    char const c = i == input.size() ? ' ' : input[i];
+    if (c == ' ' || c == '\n' || c == ';' || c == ',' || c == '(' || c == ')') {
+      if (i != begin) {
+        out.emplace_back(input.data() + begin, i - begin);
+      }
+      begin = i + 1;
+    }
+  }
+  return out;
+}
+
+void BM_preset_matches(benchmark::State& state, MutableRegex* preset) {
+  std::string input = bench::source_code(state.range(0));
+  auto toks         = tokens(input);
+
+  for (auto _ : state) {
+    for (auto tok : toks) {
+      auto result = preset->matches(tok);
+      benchmark::DoNotOptimize(result);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.SetItemsProcessed(state.iterations() * toks.size());
+}
+
+void BM_preset_find_many(benchmark::State& state, MutableRegex* preset) {
+  std::string input = bench::source_code(state.range(0));
+
+  for (auto _ : state) {
+    auto results = preset->find_many(input.c_str());
+    benchmark::DoNotOptimize(results);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+} // namespace
+
+#define PRESET_BENCHMARKS(name)                                                                                        \
+  BENCHMARK_CAPTURE(BM_preset_matches, name, &presets::name)->Range(1 << 12, 1 << 18);                                 \
+  BENCHMARK_CAPTURE(BM_preset_find_many, name, &presets::name)->Range(1 << 10, 1 << 14);
+
+PRESET_BENCHMARKS(digit)
+PRESET_BENCHMARKS(integer)
+PRESET_BENCHMARKS(zeroprefixable_integer)
+PRESET_BENCHMARKS(simple_identifier)
+PRESET_BENCHMARKS(c_like_comment)
+
+#undef PRESET_BENCHMARKS
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+}
@@ -0,0 +1,575 @@
+// Copyright (c) 2023 Samir Bioud
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "./util/sets.h"
+#include "mutils/panic.h"
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace regex_backend {
+
+///
+/// A pattern made of a linear sequence of byte classes, each of which may be optional and / or repeated
+///
+/// these patterns need no determinization, so they are cheap to compile, which suits patterns that are
+/// built for a single request and thrown away. See BitParallelMachine and LinearMachine
+///
+class LinearPattern {
+public:
+  // An upper bound for match_repeat() without a limit
+  static constexpr size_t UNBOUNDED = std::numeric_limits<size_t>::max();
+
+  struct Element {
+    std::array<bool, 256> bytes{}; // the bytes accepted at this position
+    bool optional = false;         // the position may be skipped
+    bool repeat   = false;         // the position may match any number of consecutive times
+  };
+
+private:
+  std::vector<Element> m_elements;
+
+  LinearPattern& push(std::string_view chars, bool optional, bool repeat) {
+    Element e;
+    for (unsigned char c : chars) {
+      e.bytes[c] = true;
+    }
+    e.optional = optional;
+    e.repeat   = repeat;
+    m_elements.push_back(e);
+    return *this;
+  }
+
+public:
+  ///
+  /// Match exactly one of the given bytes
+  ///
+  LinearPattern& match_any_of(std::string_view chars) {
+    return push(chars, false, false);
+  }
+
+  ///
+  /// Match each byte of the sequence in turn
+  ///
+  LinearPattern& match_sequence(std::string_view seq) {
+    for (char c : seq) {
+      push(std::string_view(&c, 1), false, false);
+    }
+    return *this;
+  }
+
+  ///
+  /// Match any single byte
+  ///
+  LinearPattern& match_default() {
+    Element e;
+    e.bytes.fill(true);
+    m_elements.push_back(e);
+    return *this;
+  }
+
+  ///
+  /// Match zero or one of the given bytes
+  ///
+  LinearPattern& match_optionally(std::string_view chars) {
+    return push(chars, true, false);
+  }
+
+  ///
+  /// Match one or more of the given bytes
+  ///
+  LinearPattern& match_many(std::string_view chars) {
+    return push(chars, false, true);
+  }
+
+  ///
+  /// Match zero or more of the given bytes
+  ///
+  LinearPattern& match_many_optionally(std::string_view chars) {
+    return push(chars, true, true);
+  }
+
+  ///
+  /// Match between min and max (inclusive) of the given bytes, max may be UNBOUNDED
+  ///
+  /// each repetition takes a position, so the state word doubles as the repetition counter
+  ///
+  LinearPattern& match_repeat(std::string_view chars, size_t min, size_t max) {
+    if (max < min) {
+      mutils::PANIC("Invalid repetition bounds: {" + std::to_string(min) + "," + std::to_string(max) + "}");
+    }
+    for (size_t i = 0; i < min; i++) {
+      match_any_of(chars);
+    }
+    if (max == UNBOUNDED) {
+      if (min == 0) {
+        return match_many_optionally(chars);
+      }
+      m_elements.back().repeat = true;
+      return *this;
+    }
+    for (size_t i = min; i < max; i++) {
+      match_optionally(chars);
+    }
+    return *this;
+  }
+
+  LinearPattern& match_alpha() {
+    return match_any_of(internal::charsets::ALPHABET_FULL);
+  }
+
+  LinearPattern& match_digit() {
+    return match_any_of(internal::charsets::DIGITS);
+  }
+
+  std::vector<Element> const& elements() const {
+    return m_elements;
+  }
+
+  size_t position_count() const {
+    return m_elements.size();
+  }
+};
+
+namespace internal {
+
+///
+/// A fixed width bitset supporting the handful of arithmetic operations used by the bit-parallel engine
+///
+/// the words are processed in simple loops which the compiler unrolls (and vectorizes, for the bitwise operations)
+///
+template <size_t WORDS> struct WideBits {
+  std::array<std::uint64_t, WORDS> w{};
+
+  WideBits operator|(WideBits const& o) const {
+    WideBits r;
+    for (size_t i = 0; i < WORDS; i++) {
+      r.w[i] = w[i] | o.w[i];
+    }
+    return r;
+  }
+
+  WideBits operator&(WideBits const& o) const {
+    WideBits r;
+    for (size_t i = 0; i < WORDS; i++) {
+      r.w[i] = w[i] & o.w[i];
+    }
+    return r;
+  }
+
+  WideBits operator^(WideBits const& o) const {
+    WideBits r;
+    for (size_t i = 0; i < WORDS; i++) {
+      r.w[i] = w[i] ^ o.w[i];
+    }
+    return r;
+  }
+
+  WideBits operator~() const {
+    WideBits r;
+    for (size_t i = 0; i < WORDS; i++) {
+      r.w[i] = ~w[i];
+    }
+    return r;
+  }
+
+  WideBits operator<<(int) const {
+    // only ever shifted by a single position
+    WideBits r;
+    std::uint64_t carry = 0;
+    for (size_t i = 0; i < WORDS; i++) {
+      r.w[i] = (w[i] << 1) | carry;
+      carry  = w[i] >> 63;
+    }
+    return r;
+  }
+
+  WideBits operator-(WideBits const& o) const {
+    WideBits r;
+    std::uint64_t borrow = 0;
+    for (size_t i = 0; i < WORDS; i++) {
+      auto const d = w[i] - o.w[i];
+      r.w[i]       = d - borrow;
+      borrow       = (w[i] < o.w[i]) | (d < borrow);
+    }
+    return r;
+  }
+
+  explicit operator bool() const {
+    std::uint64_t any = 0;
+    for (auto x : w) {
+      any |= x;
+    }
+    return any != 0;
+  }
+};
+
+template <typename Bits> Bits bit(size_t i) {
+  if constexpr (std::is_same_v<Bits, std::uint64_t>) {
+    return std::uint64_t(1) << i;
+  } else {
+    Bits b;
+    b.w[i / 64] = std::uint64_t(1) << (i % 64);
+    return b;
+  }
+}
+
+template <size_t MAX_POSITIONS>
+using bit_parallel_word_t =
+    std::conditional_t<(MAX_POSITIONS < 64), std::uint64_t, WideBits<(MAX_POSITIONS + 1 + 63) / 64>>;
+
+} // namespace internal
+
+///
+/// Matches a LinearPattern by simulating its position automaton, one bit per position (Shift-And)
+///
+/// bit 0 is the initial state and bit i is set once the first i positions of the pattern have matched.
+/// Optional positions are handled with the epsilon closure of extended Shift-And: every block of consecutive
+/// optional positions is delimited by the bit preceding it and its last bit, and a single subtraction
+/// propagates an active bit across the whole block.
+///
+/// Patterns of up to 63 positions step with a single 64-bit word, larger ones use a multi-word bitset
+///
+/// matches follow the same rules as StateMachine::find(), the leftmost, longest (non-empty) match is found
+///
+template <size_t MAX_POSITIONS = 63> class BitParallelMachine {
+  using Bits = internal::bit_parallel_word_t<MAX_POSITIONS>;
+
+  std::array<Bits, 256> m_classes{}; // the positions accepting each byte
+  Bits m_repeat{};                   // positions which may loop onto themselves
+  Bits m_optional{};                 // positions which may be skipped
+  Bits m_block_before{};             // the bit preceding each block of optional positions
+  Bits m_block_last{};               // the last bit of each block of optional positions
+  Bits m_final{};
+  Bits m_initial{};                  // closure of the initial state
+  std::array<bool, 256> m_can_start{};
+  size_t m_positions = 0;
+
+  __attribute__((always_inline)) Bits close(Bits d) const {
+    Bits const df = d | m_block_last;
+    return d | (m_optional & ((~(df - m_block_before)) ^ df));
+  }
+
+  __attribute__((always_inline)) Bits step(Bits d, unsigned char c) const {
+    Bits const& accepts = m_classes[c];
+    return close(((d << 1) & accepts) | (d & m_repeat & accepts));
+  }
+
+public:
+  static constexpr size_t MAX_POSITION_COUNT = MAX_POSITIONS;
+
+  struct find_result {
+    std::span<char> range; // empty when nothing matched
+  };
+
+  explicit BitParallelMachine(LinearPattern const& pattern) {
+    auto const& elements = pattern.elements();
+    if (elements.size() > MAX_POSITIONS) {
+      mutils::PANIC("A BitParallelMachine<" + std::to_string(MAX_POSITIONS) + "> cannot hold a pattern of " +
+                    std::to_string(elements.size()) + " positions");
+    }
+    m_positions = elements.size();
+
+    for (size_t i = 0; i < elements.size(); i++) {
+      auto const& e   = elements[i];
+      auto const mask = internal::bit<Bits>(i + 1);
+      for (size_t c = 0; c < 256; c++) {
+        if (e.bytes[c]) {
+          m_classes[c] = m_classes[c] | mask;
+        }
+      }
+      if (e.repeat) {
+        m_repeat = m_repeat | mask;
+      }
+      if (e.optional) {
+        m_optional = m_optional | mask;
+        if (i == 0 || !elements[i - 1].optional) {
+          m_block_before = m_block_before | internal::bit<Bits>(i);
+        }
+        if (i + 1 == elements.size() || !elements[i + 1].optional) {
+          m_block_last = m_block_last | mask;
+        }
+      }
+    }
+    m_final   = internal::bit<Bits>(m_positions);
+    m_initial = close(internal::bit<Bits>(0));
+    for (size_t c = 0; c < 256; c++) {
+      m_can_start[c] = (bool)step(m_initial, (unsigned char)c);
+    }
+  }
+
+  size_t position_count() const {
+    return m_positions;
+  }
+
+  ///
+  /// Locate the leftmost, longest non-empty match of the pattern within the input
+  ///
+  find_result find(std::span<char> input) const {
+    for (size_t begin = 0; begin < input.size(); begin++) {
+      if (!m_can_start[(unsigned char)input[begin]]) {
+        continue;
+      }
+
+      Bits d     = m_initial;
+      size_t end = 0;
+      for (size_t i = begin; i < input.size(); i++) {
+        d = step(d, (unsigned char)input[i]);
+        if (!(bool)d) {
+          break;
+        }
+        if ((bool)(d & m_final)) {
+          end = i + 1;
+        }
+      }
+      if (end != 0) {
+        return {input.subspan(begin, end - begin)};
+      }
+    }
+    return {{}};
+  }
+
+  ///
+  /// Test whether the entire input matches the pattern
+  ///
+  bool matches(std::span<char> input) const {
+    Bits d = m_initial;
+    for (char c : input) {
+      d = step(d, (unsigned char)c);
+      if (!(bool)d) {
+        return false;
+      }
+    }
+    return (bool)(d & m_final);
+  }
+};
+
+///
+/// The BitParallelMachine of a pattern of any size, its state being a bitset of as many words as the pattern needs
+///
+/// every step is a single loop over the words, carrying the shift and the borrow of the closure's subtraction from
+/// one word to the next. find() and matches() allocate the two words of state they step between once per call
+///
+class DynamicBitParallelMachine {
+  size_t m_words     = 0;
+  size_t m_positions = 0;
+
+  std::vector<std::uint64_t> m_classes; // the positions accepting each byte, m_words per byte
+  std::vector<std::uint64_t> m_repeat;
+  std::vector<std::uint64_t> m_optional;
+  std::vector<std::uint64_t> m_block_before;
+  std::vector<std::uint64_t> m_block_last;
+  std::vector<std::uint64_t> m_initial;
+  std::array<bool, 256> m_can_start{};
+
+  static void set(std::vector<std::uint64_t>& bits, size_t i) {
+    bits[i / 64] |= std::uint64_t(1) << (i % 64);
+  }
+
+  ///
+  /// Steps 'from' by the byte into 'to', returns whether any position is still active
+  ///
+  __attribute__((always_inline)) bool step(std::uint64_t const* from, std::uint64_t* to, unsigned char c) const {
+    auto const* accepts  = m_classes.data() + c * m_words;
+    std::uint64_t shift  = 0;
+    std::uint64_t borrow = 0;
+    std::uint64_t any    = 0;
+    for (size_t i = 0; i < m_words; i++) {
+      auto const d = (((from[i] << 1) | shift) | (from[i] & m_repeat[i])) & accepts[i];
+      shift        = from[i] >> 63;
+
+      // the closure of BitParallelMachine::close(), its subtraction borrowing across words
+      auto const df   = d | m_block_last[i];
+      auto const diff = df - m_block_before[i];
+      auto const sub  = diff - borrow;
+      borrow          = (df < m_block_before[i]) | (diff < borrow);
+      to[i]           = d | (m_optional[i] & (~sub ^ df));
+      any |= to[i];
+    }
+    return any != 0;
+  }
+
+  bool is_final(std::uint64_t const* d) const {
+    return d[m_positions / 64] & (std::uint64_t(1) << (m_positions % 64));
+  }
+
+public:
+  using find_result = BitParallelMachine<>::find_result;
+
+  explicit DynamicBitParallelMachine(LinearPattern const& pattern) {
+    auto const& elements = pattern.elements();
+    m_positions          = elements.size();
+    m_words              = (m_positions + 1 + 63) / 64;
+
+    m_classes.assign(256 * m_words, 0);
+    for (auto* bits : {&m_repeat, &m_optional, &m_block_before, &m_block_last, &m_initial}) {
+      bits->assign(m_words, 0);
+    }
+    for (size_t i = 0; i < elements.size(); i++) {
+      auto const& e = elements[i];
+      for (size_t c = 0; c < 256; c++) {
+        if (e.bytes[c]) {
+          m_classes[c * m_words + (i + 1) / 64] |= std::uint64_t(1) << ((i + 1) % 64);
+        }
+      }
+      if (e.repeat) {
+        set(m_repeat, i + 1);
+      }
+      if (e.optional) {
+        set(m_optional, i + 1);
+        if (i == 0 || !elements[i - 1].optional) {
+          set(m_block_before, i);
+        }
+        if (i + 1 == elements.size() || !elements[i + 1].optional) {
+          set(m_block_last, i + 1);
+        }
+      }
+    }
+
+    // closure of the initial state, bit 0 propagates across the block of optional positions leading the pattern
+    set(m_initial, 0);
+    for (size_t i = 0; i < elements.size() && elements[i].optional; i++) {
+      set(m_initial, i + 1);
+    }
+
+    std::vector<std::uint64_t> next(m_words);
+    for (size_t c = 0; c < 256; c++) {
+      m_can_start[c] = step(m_initial.data(), next.data(), (unsigned char)c);
+    }
+  }
+
+  size_t position_count() const {
+    return m_positions;
+  }
+
+  ///
+  /// Locate the leftmost, longest non-empty match of the pattern within the input
+  ///
+  find_result find(std::span<char> input) const {
+    std::vector<std::uint64_t> state(2 * m_words);
+    for (size_t begin = 0; begin < input.size(); begin++) {
+      if (!m_can_start[(unsigned char)input[begin]]) {
+        continue;
+      }
+
+      auto* d    = state.data();
+      auto* next = state.data() + m_words;
+      std::copy(m_initial.begin(), m_initial.end(), d);
+      size_t end = 0;
+      for (size_t i = begin; i < input.size(); i++) {
+        if (!step(d, next, (unsigned char)input[i])) {
+          break;
+        }
+        std::swap(d, next);
+        if (is_final(d)) {
+          end = i + 1;
+        }
+      }
+      if (end != 0) {
+        return {input.subspan(begin, end - begin)};
+      }
+    }
+    return {{}};
+  }
+
+  ///
+  /// Test whether the entire input matches the pattern
+  ///
+  bool matches(std::span<char> input) const {
+    std::vector<std::uint64_t> state(2 * m_words);
+    auto* d    = state.data();
+    auto* next = state.data() + m_words;
+    std::copy(m_initial.begin(), m_initial.end(), d);
+    for (char c : input) {
+      if (!step(d, next, (unsigned char)c)) {
+        return false;
+      }
+      std::swap(d, next);
+    }
+    return is_final(d);
+  }
+};
+
+///
+/// Compiles a LinearPattern with the cheapest engine able to hold it
+///
+/// patterns of up to 63 positions use the single word BitParallelMachine, up to 255 positions the fixed multi-word
+/// one, and anything larger the DynamicBitParallelMachine. None of them is determinized, so compiling is linear in
+/// the size of the pattern whatever its size
+///
+class LinearMachine {
+  std::variant<BitParallelMachine<63>, BitParallelMachine<255>, DynamicBitParallelMachine> m_engine;
+
+  static std::variant<BitParallelMachine<63>, BitParallelMachine<255>, DynamicBitParallelMachine>
+  compile(LinearPattern const& pattern) {
+    if (pattern.position_count() <= 63) {
+      return BitParallelMachine<63>(pattern);
+    }
+    if (pattern.position_count() <= 255) {
+      return BitParallelMachine<255>(pattern);
+    }
+    return DynamicBitParallelMachine(pattern);
+  }
+
+public:
+  using find_result = BitParallelMachine<>::find_result;
+
+  explicit LinearMachine(LinearPattern const& pattern) : m_engine(compile(pattern)) {
+  }
+
+  ///
+  /// The name of the selected engine, useful for diagnostics
+  ///
+  char const* engine() const {
+    switch (m_engine.index()) {
+      case 0: return "bit_parallel/64";
+      case 1: return "bit_parallel/256";
+      default: return "bit_parallel/dynamic";
+    }
+  }
+
+  find_result find(std::span<char> input) const {
+    return std::visit(
+        [&](auto const& engine) -> find_result {
+          return {engine.find(input).range};
+        },
+        m_engine);
+  }
+
+  bool matches(std::span<char> input) const {
+    return std::visit(
+        [&](auto const& engine) -> bool {
+          return (bool)engine.matches(input);
+        },
+        m_engine);
+  }
+};
+
+}; // namespace regex_backend
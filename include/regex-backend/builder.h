@@ -22,6 +22,7 @@
 #pragma once
 
 #include "./node.h"
+#include "./state_machine_internal/memory_usage.h"
 #include "mutils/assert.h"
 #include "mutils/panic.h"
 #include "mutils/stringify.h"
@@ -477,6 +478,43 @@ public:
     return *this;
   }
 
+  /**
+   * A breakdown of the memory held by the machine, see internal::MemoryUsage
+   */
+  internal::MemoryUsage memory_usage() const {
+    internal::MemoryUsage usage;
+    usage.node_count = _m_nodes.size();
+
+    internal::ByteClassCounter<size_t> classes;
+    for (size_t i = 0; i < _m_nodes.size(); i++) {
+      auto const& node = _m_nodes[i];
+      usage.transition_slots += node.transitions.size();
+      // the final transition is eof, every other is a character
+      for (size_t c = 0; c < node.transitions.size(); c++) {
+        if (node.transitions[c] != 0) {
+          usage.nonzero_transitions++;
+          if (c < node.transitions.size() - 1) {
+            classes.add(c, i + 1, node.transitions[c]);
+          }
+        }
+      }
+    }
+    usage.byte_classes = classes.count(128);
+
+    size_t value_size = 0;
+    if constexpr (std::is_same_v<Value_T, void>) {
+      value_size = sizeof(Node_T::terminal);
+    } else {
+      value_size = sizeof(Node_T::value);
+    }
+    usage.transition_bytes   = _m_nodes.size() * sizeof(StateMachineNodeBase::transitions);
+    usage.value_bytes        = _m_nodes.size() * value_size;
+    usage.construction_bytes = sizeof(on_conflict) + sizeof(m_cursors) + m_cursors.capacity() * sizeof(size_t);
+    usage.overhead_bytes     = sizeof(_m_nodes) + _m_nodes.capacity() * sizeof(Node_T) - usage.transition_bytes -
+                           usage.value_bytes;
+    return usage;
+  }
+
   /**
    * Dump a textual representation of the state machine to
    * stdout
@@ -737,7 +775,7 @@ public:
       }
       return_value.push_back(result);
       // Update the cursor to be equal to end + 1
-      cur = result.end;
+      cur = result.end + 1;
     }
 
     return return_value;
@@ -0,0 +1,459 @@
+// Copyright (c) 2023 Samir Bioud
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#pragma once
+
+#include "./state_machine.h"
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace regex_backend {
+
+template <typename Machine_T> class GlobSet;
+
+template <typename Machine_T> GlobSet<Machine_T> compile_globs(std::span<std::string const> globs);
+
+///
+/// A set of globs compiled by compile_globs() into a single machine, which checks a path against every glob at once
+/// in a single pass over its bytes
+///
+/// the supported syntax follows gitignore:
+///   ?               any character but '/'
+///   *               any run of characters without '/'
+///   **              as a whole path segment, any number of segments including none: **/a, a/**/b, a/**
+///   [abc] [a-z]     classes, negated by a leading '!' or '^', never matching '/'
+///   \c              the character c
+///
+/// a glob without a '/' (ignoring a trailing one) matches at any depth, otherwise it is anchored to the root of the
+/// path, a leading '/' only serving as an anchor. A trailing '/' restricts the glob to directories, matching the paths
+/// beneath them, and every other glob also matches the paths beneath its matches
+///
+/// when several globs match a path, the last one of them wins. Negations ('!') are left to the caller, which strips
+/// them before compiling and checks whether the winning glob was negated
+///
+/// like git, globs are matched bytewise: '?', '*' and negated classes also match every byte outside of ascii, so '?'
+/// matches a single byte of a multi-byte utf8 character. Globs may only hold ascii characters, as char machines have no
+/// transitions of their own for the other bytes
+///
+template <typename Machine_T = StateMachine<size_t, char>> class GlobSet {
+  Machine_T m_machine;
+  size_t m_size = 0;
+
+  char const* m_error   = nullptr;
+  size_t m_error_glob   = 0;
+  size_t m_error_offset = 0;
+
+  friend GlobSet compile_globs<Machine_T>(std::span<std::string const>);
+
+public:
+  using input_t = typename Machine_T::input_t;
+
+  bool is_error() const {
+    return m_error != nullptr;
+  }
+
+  char const* error_message() const {
+    return m_error;
+  }
+
+  ///
+  /// The index of the glob holding the error
+  ///
+  size_t error_glob() const {
+    return m_error_glob;
+  }
+
+  ///
+  /// The offset within the glob at which the error was found
+  ///
+  size_t error_offset() const {
+    return m_error_offset;
+  }
+
+  ///
+  /// The compiled machine, exit points hold the index of the winning glob
+  ///
+  Machine_T const& machine() const {
+    return m_machine;
+  }
+
+  ///
+  /// The number of globs in the set
+  ///
+  size_t size() const {
+    return m_size;
+  }
+
+  ///
+  /// The index of the last glob matching the entire path, or std::nullopt when none does
+  ///
+  std::optional<size_t> match(std::span<input_t> path) const {
+    auto const result = m_machine.matches(path);
+    if (!result) {
+      return std::nullopt;
+    }
+    return *result.value();
+  }
+};
+
+namespace internal {
+
+///
+/// The globs of a GlobSet as a single nondeterministic automaton over bytes, determinized into the machine
+///
+class GlobAutomaton {
+  ///
+  /// A set of bytes, the bytes outside of ascii being either all in the set or all out of it
+  ///
+  struct ByteSet {
+    std::bitset<128> ascii;
+    bool high = false;
+
+    static ByteSet of(char c) {
+      ByteSet set;
+      set.ascii.set((unsigned char)c);
+      return set;
+    }
+
+    static ByteSet any() {
+      ByteSet set;
+      set.ascii.set();
+      set.high = true;
+      return set;
+    }
+
+    static ByteSet any_but_slash() {
+      auto set = any();
+      set.ascii.reset('/');
+      return set;
+    }
+  };
+
+  struct Edge {
+    ByteSet bytes;
+    size_t to;
+  };
+
+  struct State {
+    std::vector<Edge> edges     = {};
+    std::vector<size_t> epsilon = {};
+    size_t owner                = 0;     // the glob this state belongs to
+    std::optional<size_t> glob  = {};    // the glob accepting in this state
+    bool absorbing              = false; // accepts every continuation, as beneath a match
+  };
+
+  std::vector<State> m_states;
+  std::vector<size_t> m_starts;
+
+  // parsing state of the current glob
+  std::string_view m_glob;
+  size_t m_pos = 0;
+  size_t m_id  = 0;
+
+  char const* m_error   = nullptr;
+  size_t m_error_offset = 0;
+
+  bool fail(char const* message, size_t offset) {
+    m_error        = message;
+    m_error_offset = offset;
+    return false;
+  }
+
+  size_t add_state() {
+    m_states.push_back({.owner = m_id});
+    return m_states.size() - 1;
+  }
+
+  size_t step(size_t from, ByteSet const& bytes) {
+    auto const to = add_state();
+    m_states[from].edges.push_back({bytes, to});
+    return to;
+  }
+
+  ///
+  /// Any number of path segments, including none, as in '**/'
+  ///
+  size_t segments(size_t from) {
+    auto const inside = step(from, ByteSet::any());
+    auto const to     = step(inside, ByteSet::of('/'));
+    m_states[inside].edges.push_back({ByteSet::any(), inside});
+    m_states[from].edges.push_back({ByteSet::of('/'), to});
+    m_states[from].epsilon.push_back(to);
+    return to;
+  }
+
+  bool at_segment_start() const {
+    return m_pos == 0 || m_glob[m_pos - 1] == '/';
+  }
+
+  bool ascii(char c, size_t offset) {
+    if ((unsigned char)c >= 0x80) {
+      return fail("Non-ascii characters cannot be matched by the nodes of a char machine", offset);
+    }
+    return true;
+  }
+
+  std::optional<ByteSet> character_class() {
+    auto const open = m_pos++;
+    bool const negated = m_pos < m_glob.size() && (m_glob[m_pos] == '!' || m_glob[m_pos] == '^');
+    m_pos += negated;
+
+    ByteSet set;
+    auto const member = [&]() -> std::optional<char> {
+      if (m_glob[m_pos] == '\\' && m_pos + 1 < m_glob.size()) {
+        m_pos++;
+      }
+      auto const c = m_glob[m_pos];
+      if (!ascii(c, m_pos)) {
+        return std::nullopt;
+      }
+      m_pos++;
+      return c;
+    };
+
+    // a ']' leading the class is one of its members
+    for (bool first = true; m_pos < m_glob.size() && (first || m_glob[m_pos] != ']'); first = false) {
+      auto const low = member();
+      if (!low) {
+        return std::nullopt;
+      }
+      auto high = low;
+      if (m_pos + 1 < m_glob.size() && m_glob[m_pos] == '-' && m_glob[m_pos + 1] != ']') {
+        m_pos++;
+        high = member();
+        if (!high) {
+          return std::nullopt;
+        }
+      }
+      for (int c = *low; c <= *high; c++) {
+        set.ascii.set(c);
+      }
+    }
+    if (m_pos >= m_glob.size()) {
+      fail("Unterminated character class", open);
+      return std::nullopt;
+    }
+    m_pos++;
+
+    if (negated) {
+      set.ascii.flip();
+      set.high = true;
+    }
+    // classes never match '/'
+    set.ascii.reset('/');
+    return set;
+  }
+
+  std::vector<size_t> closure(std::vector<size_t> states) const {
+    for (size_t i = 0; i < states.size(); i++) {
+      for (auto to : m_states[states[i]].epsilon) {
+        if (std::find(states.begin(), states.end(), to) == states.end()) {
+          states.push_back(to);
+        }
+      }
+    }
+    // once beneath a match of a glob, the states of the globs before it can never win again
+    size_t absorbed = 0;
+    for (auto s : states) {
+      if (m_states[s].absorbing) {
+        absorbed = std::max(absorbed, m_states[s].owner);
+      }
+    }
+    std::erase_if(states, [&](size_t s) {
+      return m_states[s].owner < absorbed;
+    });
+
+    std::sort(states.begin(), states.end());
+    states.erase(std::unique(states.begin(), states.end()), states.end());
+    return states;
+  }
+
+public:
+  using Set = std::vector<size_t>;
+
+  char const* error_message() const {
+    return m_error;
+  }
+
+  size_t error_offset() const {
+    return m_error_offset;
+  }
+
+  ///
+  /// Adds a glob, accepting with 'id', returns false on a malformed glob
+  ///
+  bool add(std::string_view glob, size_t id) {
+    m_glob = glob;
+    m_pos  = 0;
+    m_id   = id;
+
+    bool const directory_only = m_glob.ends_with('/') && !m_glob.ends_with("\\/");
+    if (directory_only) {
+      m_glob.remove_suffix(1);
+    }
+    if (m_glob.empty() || m_glob == "/") {
+      return fail("Empty glob", 0);
+    }
+
+    auto current = add_state();
+    m_starts.push_back(current);
+    if (m_glob.starts_with('/')) {
+      m_pos = 1;
+    } else if (m_glob.find('/') == std::string_view::npos) {
+      current = segments(current);
+    }
+
+    while (m_pos < m_glob.size()) {
+      auto const c = m_glob[m_pos];
+      if (c == '*' && at_segment_start() && m_glob.substr(m_pos).starts_with("**") &&
+          (m_pos + 2 == m_glob.size() || m_glob[m_pos + 2] == '/')) {
+        if (m_pos + 2 == m_glob.size()) {
+          m_states[current].edges.push_back({ByteSet::any(), current});
+          m_pos += 2;
+        } else {
+          current = segments(current);
+          m_pos += 3;
+        }
+      } else if (c == '*') {
+        while (m_pos < m_glob.size() && m_glob[m_pos] == '*') {
+          m_pos++;
+        }
+        m_states[current].edges.push_back({ByteSet::any_but_slash(), current});
+      } else if (c == '?') {
+        current = step(current, ByteSet::any_but_slash());
+        m_pos++;
+      } else if (c == '[') {
+        auto const set = character_class();
+        if (!set) {
+          return false;
+        }
+        current = step(current, *set);
+      } else {
+        if (c == '\\' && ++m_pos == m_glob.size()) {
+          return fail("Trailing backslash", m_pos - 1);
+        }
+        if (!ascii(m_glob[m_pos], m_pos)) {
+          return false;
+        }
+        current = step(current, ByteSet::of(m_glob[m_pos++]));
+      }
+    }
+
+    // the paths beneath a match, which a directory glob requires
+    auto const beneath = step(current, ByteSet::of('/'));
+    m_states[beneath].edges.push_back({ByteSet::any(), beneath});
+    m_states[beneath].glob      = id;
+    m_states[beneath].absorbing = true;
+    if (!directory_only) {
+      m_states[current].glob = id;
+    }
+    return true;
+  }
+
+  Set root() const {
+    return closure(m_starts);
+  }
+
+  ///
+  /// The state of the determinized automaton reached by a set of states, see StateMachine::from_automaton()
+  ///
+  template <typename Machine_T> auto expand(Set const& set) const {
+    typename Machine_T::template automaton_state<Set> out;
+
+    std::array<Set, 128> ascii;
+    Set high;
+    for (auto s : set) {
+      auto const& state = m_states[s];
+      if (state.glob && (!out.exit || out.exit->value < *state.glob)) {
+        out.exit = {typename Machine_T::value_t(*state.glob), 0};
+      }
+      for (auto const& edge : state.edges) {
+        for (size_t c = 0; c < 128; c++) {
+          if (edge.bytes.ascii.test(c)) {
+            ascii[c].push_back(edge.to);
+          }
+        }
+        if (edge.bytes.high) {
+          high.push_back(edge.to);
+        }
+      }
+    }
+
+    // bytes outside of ascii have no transition of their own, and take the default transition
+    if (!high.empty()) {
+      out.fallback = closure(std::move(high));
+    }
+    for (size_t c = 0; c < 128; c++) {
+      if (ascii[c].empty()) {
+        if (out.fallback) {
+          out.transitions.emplace_back(char(c), std::nullopt);
+        }
+        continue;
+      }
+      auto next = closure(std::move(ascii[c]));
+      if (next != out.fallback) {
+        out.transitions.emplace_back(char(c), std::move(next));
+      }
+    }
+    return out;
+  }
+};
+
+} // namespace internal
+
+///
+/// Compile a list of globs into a single machine, see GlobSet for the supported syntax
+///
+/// syntax errors are reported through GlobSet::is_error(), GlobSet::error_message() and GlobSet::error_glob()
+///
+template <typename Machine_T = StateMachine<size_t, char>>
+GlobSet<Machine_T> compile_globs(std::span<std::string const> globs) {
+  static_assert(std::is_same_v<typename Machine_T::transition_t, char>, "Globs are matched by char machines");
+
+  GlobSet<Machine_T> set;
+  set.m_size = globs.size();
+
+  internal::GlobAutomaton automaton;
+  for (size_t i = 0; i < globs.size(); i++) {
+    if (!automaton.add(globs[i], i)) {
+      set.m_error        = automaton.error_message();
+      set.m_error_glob   = i;
+      set.m_error_offset = automaton.error_offset();
+      return set;
+    }
+  }
+
+  set.m_machine = Machine_T::from_automaton(automaton.root(), [&](auto const& states) {
+    return automaton.template expand<Machine_T>(states);
+  });
+  return set;
+}
+
+}; // namespace regex_backend
@@ -0,0 +1,236 @@
+// Copyright (c) 2023 Samir Bioud
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "./state_machine.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace regex_backend {
+
+///
+/// A lazily determinized union of many rule machines
+///
+/// merging many rules into a single StateMachine determinizes them eagerly, which for some rule sets
+/// (such as many match_many_optionally loops over overlapping classes) produces a machine far larger than its rules.
+/// Instead, every rule is built and optimized on its own, and their union is only determinized while matching:
+/// each state of the union is the set of rule states which are still alive, and is created the first time
+/// the input reaches it. The created states are cached, up to 'max_cached_states' of them, after which the whole cache
+/// is flushed and rebuilt on demand, so that memory stays bounded whatever the input.
+///
+/// matches follow the same rules as StateMachine::find(), the leftmost, longest match is found,
+/// and when several rules match the same range, the rule added first wins
+///
+/// NOTE: Matching fills the cache, so unlike StateMachine, a LazyStateMachine may not be shared between threads,
+/// and its match functions may allocate whenever a new state is created
+///
+template <typename Machine_T = StateMachine<void, char>> class LazyStateMachine {
+  using input_t = typename Machine_T::input_t;
+  static_assert(sizeof(input_t) == 1, "The lazy engine transitions on bytes");
+
+  static constexpr std::uint32_t UNKNOWN = UINT32_MAX;     // transition not computed yet
+  static constexpr std::uint32_t DEAD    = UINT32_MAX - 1; // no rule survives the transition
+
+  ///
+  /// The live state of each rule, kept sorted by rule
+  ///
+  using Members = std::vector<std::pair<std::uint32_t, size_t>>;
+
+  struct Exit {
+    std::uint32_t rule;
+    size_t back_by;
+  };
+
+  struct CachedState {
+    Members members;
+    std::optional<Exit> exit;
+    std::array<std::uint32_t, 256> next;
+  };
+
+  std::vector<Machine_T> m_rules;
+  size_t m_max_cached_states;
+
+  std::vector<CachedState> m_states;
+  std::map<Members, std::uint32_t> m_index;
+  std::uint32_t m_start = UNKNOWN;
+  Members m_scratch;
+
+  size_t m_flushes        = 0;
+  size_t m_states_created = 0;
+
+public:
+  struct find_result {
+    std::span<input_t> range;
+    std::optional<size_t> rule; // index of the matched rule, empty when nothing matched
+  };
+
+  ///
+  /// Counters describing how well the state cache holds up
+  ///
+  struct cache_stats_t {
+    size_t cached_states;  // states currently cached
+    size_t states_created; // states created since construction, including those flushed since
+    size_t flushes;        // times the cache was full and had to be cleared
+  };
+
+  ///
+  /// 'rules' should each be optimized beforehand, the cache holds at most 'max_cached_states' states (at least 2)
+  ///
+  explicit LazyStateMachine(std::vector<Machine_T> rules, size_t max_cached_states = 4096) :
+      m_rules(std::move(rules)), m_max_cached_states(std::max<size_t>(max_cached_states, 2)) {
+  }
+
+  ///
+  /// Locate the leftmost, longest match of any rule within the input
+  ///
+  find_result find(std::span<input_t> input) {
+    for (size_t begin = 0; begin < input.size(); begin++) {
+      std::uint32_t current = start();
+      std::optional<Exit> exit;
+      size_t end = 0;
+
+      for (size_t i = begin; i < input.size(); i++) {
+        current = transition(current, input[i]);
+        if (current == DEAD) {
+          break;
+        }
+        if (m_states[current].exit) {
+          exit = m_states[current].exit;
+          end  = i + 1;
+        }
+      }
+
+      if (exit) {
+        return {input.subspan(begin, end - std::min(exit->back_by, end - begin) - begin), exit->rule};
+      }
+    }
+    return {{}, std::nullopt};
+  }
+
+  ///
+  /// Test whether the entire input matches any rule, returns the index of the first such rule
+  ///
+  std::optional<size_t> matches(std::span<input_t> input) {
+    std::uint32_t current = start();
+    for (auto c : input) {
+      current = transition(current, c);
+      if (current == DEAD) {
+        return std::nullopt;
+      }
+    }
+    if (m_states[current].exit) {
+      return m_states[current].exit->rule;
+    }
+    return std::nullopt;
+  }
+
+  cache_stats_t cache_stats() const {
+    return {m_states.size(), m_states_created, m_flushes};
+  }
+
+  size_t rule_count() const {
+    return m_rules.size();
+  }
+
+private:
+  std::uint32_t start() {
+    if (m_start == UNKNOWN) {
+      m_scratch.clear();
+      for (std::uint32_t r = 0; r < m_rules.size(); r++) {
+        m_scratch.emplace_back(r, Machine_T::ROOT_STATE);
+      }
+      m_start = intern();
+    }
+    return m_start;
+  }
+
+  ///
+  /// The state reached from 'from', created (and cached) if it has not been seen yet
+  ///
+  std::uint32_t transition(std::uint32_t from, input_t c) {
+    auto const key     = (unsigned char)c;
+    std::uint32_t next = m_states[from].next[key];
+    if (next != UNKNOWN) {
+      return next;
+    }
+
+    m_scratch.clear();
+    for (auto const& [rule, state] : m_states[from].members) {
+      auto const to = m_rules[rule].step(state, c);
+      if (to != 0) {
+        m_scratch.emplace_back(rule, to);
+      }
+    }
+
+    if (m_scratch.empty()) {
+      next = DEAD;
+    } else if (auto found = m_index.find(m_scratch); found != m_index.end()) {
+      next = found->second;
+    } else {
+      if (m_states.size() >= m_max_cached_states) {
+        // 'from' is flushed along with everything else, so the link is not recorded
+        flush();
+        return intern();
+      }
+      next = intern();
+    }
+    m_states[from].next[key] = next;
+    return next;
+  }
+
+  ///
+  /// Cache the members held in m_scratch as a new state
+  ///
+  std::uint32_t intern() {
+    CachedState state;
+    state.members = m_scratch;
+    state.next.fill(UNKNOWN);
+    for (auto const& [rule, s] : m_scratch) {
+      if (auto back_by = m_rules[rule].exit_back_by(s)) {
+        state.exit = Exit{rule, *back_by};
+        break;
+      }
+    }
+
+    auto const id = (std::uint32_t)m_states.size();
+    m_states.push_back(std::move(state));
+    m_index.emplace(m_scratch, id);
+    m_states_created++;
+    return id;
+  }
+
+  void flush() {
+    m_states.clear();
+    m_index.clear();
+    m_start = UNKNOWN;
+    m_flushes++;
+  }
+};
+
+}; // namespace regex_backend
@@ -0,0 +1,149 @@
+// Copyright (c) 2023 Samir Bioud
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#pragma once
+
+#include "./state_machine.h"
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace regex_backend {
+
+///
+/// Splits an input into tokens, each one being the longest match of a set of token patterns
+///
+/// the patterns are compiled into a single machine, so lexing takes one pass over the input: every element is stepped
+/// through once, on top of the elements read past the end of a token while looking for a longer one. When several
+/// patterns match the same longest token, the pattern given first decides its kind.
+///
+/// a pattern's trailing context (see exit_point()'s 'back_by') is left out of the token, and lexing resumes right
+/// after it. Patterns may also match the end of the input (see match_eof()), which is only ever tried at the end of
+/// the input given to next_token() or tokenize()
+///
+/// NOTE: like StreamMatcher, the lexer does not validate utf8, malformed sequences simply fail to match
+///
+template <typename Token_T, typename Pattern_T = StateMachine<void, char>> class Lexer {
+public:
+  using transition_t = typename Pattern_T::transition_t;
+  using Machine_T    = StateMachine<Token_T, transition_t>;
+  using input_t      = typename Machine_T::input_t;
+
+  struct rule {
+    Pattern_T const& pattern;
+    Token_T token;
+  };
+
+  struct token {
+    Token_T kind;
+    std::span<input_t> range;
+  };
+
+private:
+  Machine_T m_machine;
+
+public:
+  ///
+  /// Compile the rules, in decreasing priority, the patterns are not referenced once compiled
+  ///
+  Lexer(std::span<rule const> rules) {
+    std::vector<std::pair<Pattern_T const*, Token_T>> patterns;
+    patterns.reserve(rules.size());
+    for (auto const& r : rules) {
+      patterns.emplace_back(&r.pattern, r.token);
+    }
+    m_machine = Machine_T::prioritized_union(std::span<std::pair<Pattern_T const*, Token_T> const>(patterns));
+  }
+
+  Lexer(std::initializer_list<rule> rules) : Lexer(std::span<rule const>(rules.begin(), rules.size())) {
+  }
+
+  ///
+  /// The longest token at the start of the input, or std::nullopt when no pattern matches a non-empty prefix of it
+  ///
+  std::optional<token> next_token(std::span<input_t> input) const {
+    size_t state  = Machine_T::ROOT_STATE;
+    size_t accept = 0; // most specific exit state, 0 when none was reached
+    size_t size   = 0; // elements consumed up to 'accept'
+
+    size_t i = 0;
+    for (; i < input.size(); i++) {
+      state = m_machine.step(state, input[i]);
+      if (state == 0) {
+        break;
+      }
+      if (m_machine.exit_back_by(state)) {
+        accept = state;
+        size   = i + 1;
+      }
+    }
+    if (state != 0 && i == input.size()) {
+      auto const end = m_machine.step_eof(state);
+      if (end != 0 && m_machine.exit_back_by(end)) {
+        accept = end;
+        size   = i;
+      }
+    }
+
+    if (accept == 0) {
+      return std::nullopt;
+    }
+    size -= std::min(*m_machine.exit_back_by(accept), size);
+    if (size == 0) {
+      return std::nullopt;
+    }
+    return token{*m_machine.exit_value(accept), input.first(size)};
+  }
+
+  ///
+  /// Append the tokens of the input to 'out', one after the other
+  ///
+  /// returns the number of elements consumed, which falls short of the input size when its remainder starts with no
+  /// token
+  ///
+  size_t tokenize(std::span<input_t> input, std::vector<token>& out) const {
+    size_t offset = 0;
+    while (offset < input.size()) {
+      auto const next = next_token(input.subspan(offset));
+      if (!next) {
+        break;
+      }
+      out.push_back(*next);
+      offset += next->range.size();
+    }
+    return offset;
+  }
+
+  ///
+  /// The compiled machine, exit points hold the kind of their token
+  ///
+  Machine_T const& machine() const {
+    return m_machine;
+  }
+};
+
+}; // namespace regex_backend
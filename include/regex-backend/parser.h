@@ -0,0 +1,1027 @@
+// Copyright (c) 2023 Samir Bioud
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#pragma once
+
+#include "./state_machine.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <bitset>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace regex_backend {
+
+namespace internal {
+template <typename Machine_T> class RegexParser;
+}
+
+///
+/// A machine compiled from a textual pattern by compile_regex()
+///
+/// the supported syntax is:
+///   literals and escapes        a \. \\ \n \t \r \f \v \xHH \x{HHHH}
+///   classes                     [abc] [a-z] [^abc] . \d \D \w \W \s \S
+///   unicode classes (char32_t)  \p{L} \p{Lu} \p{Ll} \p{N} \p{Latin} \p{Greek} \p{Cyrillic} and \P{...}
+///   groups                      (captured) (?:not captured)
+///   alternation                 a|b
+///   quantifiers                 * + ? {n} {n,} {n,m}
+///   anchors                     ^ at the start and $ at the end of the pattern
+///   flags                       (?i) at the start of the pattern folds case
+///
+/// the negated classes and '.' (which excludes '\n') range over ascii on char machines, and over the
+/// one and two byte utf8 codepoints [U+0001 - U+07FF] on char32_t machines. Unicode classes cover the latin, greek and
+/// cyrillic letters within that range
+///
+/// matching follows StateMachine::find(), so the leftmost, longest non-empty match is found
+///
+/// patterns nesting groups deeper than MAX_GROUP_DEPTH, repeating more than MAX_REPEAT_COUNT times, or whose
+/// automaton grows past MAX_PATTERN_STATES (before determinization) or MAX_MACHINE_STATES (after it) are errors
+///
+template <typename Machine_T = StateMachine<void, char>> class Regex {
+  Machine_T m_machine;
+  bool m_anchored_begin = false;
+  bool m_anchored_end   = false;
+  size_t m_captures     = 0;
+
+  char const* m_error   = nullptr;
+  size_t m_error_offset = 0;
+
+  template <typename> friend class internal::RegexParser;
+
+public:
+  using input_t     = typename Machine_T::input_t;
+  using find_result = typename Machine_T::find_result;
+
+  static constexpr size_t MAX_GROUP_DEPTH    = 1000;
+  static constexpr size_t MAX_REPEAT_COUNT   = 1000;
+  static constexpr size_t MAX_PATTERN_STATES = 100000;
+  static constexpr size_t MAX_MACHINE_STATES = 10000;
+
+  bool is_error() const {
+    return m_error != nullptr;
+  }
+
+  char const* error_message() const {
+    return m_error;
+  }
+
+  ///
+  /// The offset within the pattern at which the error was found
+  ///
+  size_t error_offset() const {
+    return m_error_offset;
+  }
+
+  Machine_T const& machine() const {
+    return m_machine;
+  }
+
+  ///
+  /// The number of capture groups, see StateMachine::find_captures()
+  ///
+  size_t capture_count() const {
+    return m_captures;
+  }
+
+  ///
+  /// Locate the leftmost, longest match within the input, honouring the pattern's anchors
+  ///
+  find_result find(std::span<input_t> input) const {
+    // searching nothing yields the machine's own representation of no match
+    auto const none = [&]() {
+      return m_machine.find(input.subspan(input.size()));
+    };
+
+    if (m_anchored_begin && m_anchored_end) {
+      return m_machine.matches(input) ? find_result(input) : none();
+    }
+
+    if (m_anchored_begin) {
+      auto result = m_machine.find(input);
+      return result.range.data() == input.data() && !result.range.empty() ? result : none();
+    }
+
+    if (m_anchored_end) {
+      auto rest = input;
+      while (!rest.empty()) {
+        auto result = m_machine.find(rest);
+        if (result.range.empty()) {
+          break;
+        }
+        if (result.range.data() + result.range.size() == input.data() + input.size()) {
+          return result;
+        }
+        rest = {result.range.data() + 1, input.data() + input.size()};
+      }
+      return none();
+    }
+
+    return m_machine.find(input);
+  }
+
+  ///
+  /// Test whether the entire input matches the pattern
+  ///
+  bool matches(std::span<input_t> input) const {
+    return (bool)m_machine.matches(input);
+  }
+};
+
+namespace internal {
+
+template <typename Machine_T> class RegexParser {
+  static constexpr bool UTF8 = std::is_same_v<typename Machine_T::transition_t, char32_t>;
+
+  // the codepoints negated classes and '.' are taken from
+  static constexpr char32_t UNIVERSE_END = UTF8 ? 0x800 : 0x80;
+
+  using Set          = std::vector<char32_t>;
+  using States       = std::vector<size_t>;
+  using Transition_T = typename Machine_T::transition_t;
+
+  ///
+  /// A state of the pattern's NFA, which compile() determinizes through StateMachine::from_automaton()
+  ///
+  /// elements are matched byte by byte, each codepoint of a char32_t machine being a path of its utf8 bytes
+  ///
+  struct State {
+    std::vector<std::pair<std::bitset<256>, size_t>> edges;
+    std::vector<size_t> epsilon;
+    std::uint16_t capture_open  = 0;
+    std::uint16_t capture_close = 0;
+    bool accepting              = false;
+  };
+
+  ///
+  /// A parsed sub-pattern, the part of the NFA leading from 'start' to 'end'
+  ///
+  /// the states of a fragment are those created while parsing it, from 'first' up to 'last', and never lead
+  /// outside of it until the fragment is joined to another, which is what lets clone() copy them
+  ///
+  struct Fragment {
+    size_t start;
+    size_t end;
+    size_t first;
+    size_t last;
+    bool has_content; // false when the fragment only ever matches the empty string
+  };
+
+  std::vector<State> m_states;
+
+  std::string_view m_pattern;
+  size_t m_pos                 = 0;
+  CaseFolding m_folding        = CaseFolding::None;
+  size_t m_captures            = 0;
+  size_t m_depth               = 0; // groups enclosing the current position
+  bool m_top_level_alternation = false;
+  size_t m_expanded            = 0; // states of the determinized NFA, see expand()
+
+  char const* m_error   = nullptr;
+  size_t m_error_offset = 0;
+
+  std::nullopt_t fail(char const* message) {
+    if (!m_error) {
+      m_error        = message;
+      m_error_offset = m_pos;
+    }
+    return std::nullopt;
+  }
+
+  bool done() const {
+    return m_pos >= m_pattern.size();
+  }
+
+  char peek() const {
+    return m_pattern[m_pos];
+  }
+
+  bool accept(char c) {
+    if (!done() && peek() == c) {
+      m_pos++;
+      return true;
+    }
+    return false;
+  }
+
+  ///
+  /// Encodes a codepoint as it is matched, as utf8 on char32_t machines and as a byte otherwise
+  ///
+  static std::string encode(char32_t cp) {
+    std::string out;
+    if (cp < 0x80) {
+      out.push_back((char)cp);
+    } else if (cp < 0x800) {
+      out.push_back((char)(0xC0 | (cp >> 6)));
+      out.push_back((char)(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+      out.push_back((char)(0xE0 | (cp >> 12)));
+      out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back((char)(0x80 | (cp & 0x3F)));
+    } else {
+      out.push_back((char)(0xF0 | (cp >> 18)));
+      out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+      out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back((char)(0x80 | (cp & 0x3F)));
+    }
+    return out;
+  }
+
+  ///
+  /// Every case of every codepoint of the set, as match_any_of() folds the characters given to it
+  ///
+  Set fold(Set const& set) const {
+    if (m_folding == CaseFolding::None) {
+      return set;
+    }
+    std::vector<Transition_T> options;
+    for (auto cp : set) {
+      options.push_back(UTF8 ? case_fold::pack_utf8(cp) : Transition_T(cp));
+    }
+    Set out;
+    for (auto option : case_variants(options, m_folding)) {
+      out.push_back(UTF8 ? case_fold::unpack_utf8(option) : char32_t((unsigned char)option));
+    }
+    return normalize(out);
+  }
+
+  size_t add_state() {
+    m_states.emplace_back();
+    return m_states.size() - 1;
+  }
+
+  void link(size_t from, size_t to) {
+    m_states[from].epsilon.push_back(to);
+  }
+
+  Fragment empty() {
+    auto const state = add_state();
+    return {state, state, state, state + 1, false};
+  }
+
+  ///
+  /// The fragment matching any single codepoint of the set
+  ///
+  Fragment one_of(Set const& set) {
+    auto const first = m_states.size();
+    auto const start = add_state();
+    auto const end   = add_state();
+
+    // codepoints sharing their leading bytes share the states after those bytes
+    std::map<std::string, size_t> prefixes;
+    std::map<std::pair<size_t, size_t>, std::bitset<256>> edges;
+    for (auto cp : set) {
+      auto const bytes = encode(cp);
+      size_t from      = start;
+      for (size_t i = 0; i + 1 < bytes.size(); i++) {
+        auto [prefix, added] = prefixes.try_emplace(bytes.substr(0, i + 1), 0);
+        if (added) {
+          prefix->second = add_state();
+        }
+        edges[{from, prefix->second}].set((unsigned char)bytes[i]);
+        from = prefix->second;
+      }
+      edges[{from, end}].set((unsigned char)bytes.back());
+    }
+    for (auto const& [link, bytes] : edges) {
+      m_states[link.first].edges.emplace_back(bytes, link.second);
+    }
+    return {start, end, first, m_states.size(), true};
+  }
+
+  Fragment concatenate(Fragment const& head, Fragment const& tail) {
+    link(head.end, tail.start);
+    return {head.start, tail.end, head.first, m_states.size(), head.has_content || tail.has_content};
+  }
+
+  ///
+  /// A copy of the fragment's states, placed after every existing state
+  ///
+  Fragment clone(Fragment const& f) {
+    auto const offset = m_states.size() - f.first;
+    for (size_t s = f.first; s < f.last; s++) {
+      State copy = m_states[s];
+      for (auto& [bytes, to] : copy.edges) {
+        to += offset;
+      }
+      for (auto& to : copy.epsilon) {
+        to += offset;
+      }
+      m_states.push_back(std::move(copy));
+    }
+    return {f.start + offset, f.end + offset, f.first + offset, f.last + offset, f.has_content};
+  }
+
+  States closure(States states) const {
+    std::vector<bool> seen(m_states.size());
+    for (auto s : states) {
+      seen[s] = true;
+    }
+    for (size_t i = 0; i < states.size(); i++) {
+      for (auto to : m_states[states[i]].epsilon) {
+        if (!seen[to]) {
+          seen[to] = true;
+          states.push_back(to);
+        }
+      }
+    }
+    // states only passed through never tell two sets apart, dropping them keeps the determinized NFA small
+    std::erase_if(states, [&](size_t s) {
+      auto const& state = m_states[s];
+      return state.edges.empty() && !state.accepting && !state.capture_open && !state.capture_close;
+    });
+    std::sort(states.begin(), states.end());
+    return states;
+  }
+
+  ///
+  /// The state of the determinized NFA reached by a set of states, see StateMachine::from_automaton()
+  ///
+  /// the tags of the states of a set all land on the state they form, as they do when the builder merges states.
+  /// Past Regex::MAX_MACHINE_STATES states are left without transitions, which ends the construction early and
+  /// lets compile() report the error
+  ///
+  auto expand(States const& states) {
+    typename Machine_T::template automaton_state<States> out;
+    if (++m_expanded > Regex<Machine_T>::MAX_MACHINE_STATES) {
+      return out;
+    }
+
+    std::array<States, 256> targets;
+    for (auto s : states) {
+      auto const& state = m_states[s];
+      if (state.accepting) {
+        out.exit.emplace();
+      }
+      out.capture_open |= state.capture_open;
+      out.capture_close |= state.capture_close;
+      for (auto const& [bytes, to] : state.edges) {
+        for (size_t b = 0; b < 256; b++) {
+          // char32_t nodes drop the second bit of the bytes past ascii, see StateMachine::match_any_of()
+          if (bytes[b]) {
+            targets[UTF8 && (b & 0x80) ? b & 0b10111111 : b].push_back(to);
+          }
+        }
+      }
+    }
+    // the elements of a class lead to the same states, which are closed over once
+    std::map<States, States> closed;
+    for (size_t key = 0; key < targets.size(); key++) {
+      if (targets[key].empty()) {
+        continue;
+      }
+      auto [at, added] = closed.try_emplace(std::move(targets[key]));
+      if (added) {
+        at->second = closure(at->first);
+      }
+      out.transitions.emplace_back(Transition_T(key), at->second);
+    }
+    return out;
+  }
+
+  static void add_range(Set& set, char32_t first, char32_t last) {
+    for (char32_t c = first; c <= last; c++) {
+      set.push_back(c);
+    }
+  }
+
+  static Set normalize(Set set) {
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+    return set;
+  }
+
+  static Set complement(Set const& set) {
+    Set out;
+    for (char32_t c = 1; c < UNIVERSE_END; c++) {
+      if (!std::binary_search(set.begin(), set.end(), c)) {
+        out.push_back(c);
+      }
+    }
+    return out;
+  }
+
+  static Set digits() {
+    Set s;
+    add_range(s, '0', '9');
+    return s;
+  }
+
+  static Set word() {
+    Set s;
+    add_range(s, 'a', 'z');
+    add_range(s, 'A', 'Z');
+    add_range(s, '0', '9');
+    s.push_back('_');
+    return normalize(s);
+  }
+
+  static Set space() {
+    return normalize({' ', '\t', '\n', '\v', '\f', '\r'});
+  }
+
+  static void add_upper(Set& s) {
+    add_range(s, 'A', 'Z');
+    add_range(s, 0xC0, 0xD6);
+    add_range(s, 0xD8, 0xDE);
+    for (char32_t c = 0x100; c <= 0x17F; c++) {
+      bool const even_upper = (c <= 0x137) || (c >= 0x14A && c <= 0x177);
+      bool const odd_upper  = (c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E);
+      if ((even_upper && c % 2 == 0) || (odd_upper && c % 2 == 1) || c == 0x178) {
+        s.push_back(c);
+      }
+    }
+    add_range(s, 0x391, 0x3A1);
+    add_range(s, 0x3A3, 0x3A9);
+    add_range(s, 0x400, 0x42F);
+  }
+
+  static void add_lower(Set& s) {
+    add_range(s, 'a', 'z');
+    add_range(s, 0xDF, 0xF6);
+    add_range(s, 0xF8, 0xFF);
+    for (char32_t c = 0x100; c <= 0x17F; c++) {
+      bool const even_upper = (c <= 0x137) || (c >= 0x14A && c <= 0x177);
+      bool const odd_upper  = (c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E);
+      if ((even_upper && c % 2 == 1) || (odd_upper && c % 2 == 0 && c != 0x178)) {
+        s.push_back(c);
+      }
+    }
+    add_range(s, 0x3B1, 0x3C9);
+    add_range(s, 0x430, 0x45F);
+  }
+
+  std::optional<Set> unicode_class() {
+    if (!UTF8) {
+      return fail("Unicode classes require a char32_t machine");
+    }
+    if (!accept('{')) {
+      return fail("Expected '{' after \\p");
+    }
+    auto const close = m_pattern.find('}', m_pos);
+    if (close == std::string_view::npos) {
+      return fail("Unterminated unicode class");
+    }
+    auto const name = m_pattern.substr(m_pos, close - m_pos);
+    m_pos           = close + 1;
+
+    Set s;
+    if (name == "L" || name == "Latin" || name == "Greek" || name == "Cyrillic") {
+      add_upper(s);
+      add_lower(s);
+      s.push_back(0x3C2); // final sigma
+      if (name != "L") {
+        Set script;
+        char32_t const first = name == "Greek" ? 0x370 : name == "Cyrillic" ? 0x400 : 0;
+        char32_t const last  = name == "Greek" ? 0x3FF : name == "Cyrillic" ? 0x4FF : 0x24F;
+        for (auto c : s) {
+          if (c >= first && c <= last) {
+            script.push_back(c);
+          }
+        }
+        s = script;
+      }
+    } else if (name == "Lu") {
+      add_upper(s);
+    } else if (name == "Ll") {
+      add_lower(s);
+      s.push_back(0x3C2);
+    } else if (name == "N" || name == "Nd") {
+      s = digits();
+    } else {
+      return fail("Unknown unicode class");
+    }
+    return normalize(s);
+  }
+
+  std::optional<char32_t> hex_escape() {
+    bool const braced = accept('{');
+    size_t const max  = braced ? 6 : 2;
+    char32_t value    = 0;
+    size_t count      = 0;
+    while (!done() && count < max && std::isxdigit((unsigned char)peek())) {
+      char const c = peek();
+      value        = value * 16 + (std::isdigit((unsigned char)c) ? c - '0' : (std::tolower(c) - 'a' + 10));
+      m_pos++;
+      count++;
+    }
+    if (count == 0 || (braced && !accept('}')) || (!braced && count != 2)) {
+      return fail("Invalid hex escape");
+    }
+    return value;
+  }
+
+  ///
+  /// A single codepoint of the pattern, decoding utf8 literals
+  ///
+  std::optional<char32_t> literal() {
+    auto const lead = (unsigned char)m_pattern[m_pos++];
+    if (lead < 0x80) {
+      return lead;
+    }
+    if (!UTF8) {
+      return fail("Non-ascii characters require a char32_t machine");
+    }
+    size_t const len = std::countl_one(lead);
+    if (len < 2 || len > 4 || m_pos + len - 1 > m_pattern.size()) {
+      return fail("Malformed utf8 within the pattern");
+    }
+    char32_t cp = lead & (0x7F >> len);
+    for (size_t i = 1; i < len; i++) {
+      auto const c = (unsigned char)m_pattern[m_pos++];
+      if ((c & 0xC0) != 0x80) {
+        return fail("Malformed utf8 within the pattern");
+      }
+      cp = (cp << 6) | (c & 0x3F);
+    }
+    return cp;
+  }
+
+  ///
+  /// An escape sequence, after the backslash, as the set of codepoints it matches
+  ///
+  std::optional<Set> escape() {
+    if (done()) {
+      return fail("Dangling escape at the end of the pattern");
+    }
+    char const c = m_pattern[m_pos++];
+    switch (c) {
+      case 'd': return digits();
+      case 'D': return complement(fold(digits()));
+      case 'w': return word();
+      case 'W': return complement(fold(word()));
+      case 's': return space();
+      case 'S': return complement(fold(space()));
+      case 'n': return Set{'\n'};
+      case 't': return Set{'\t'};
+      case 'r': return Set{'\r'};
+      case 'f': return Set{'\f'};
+      case 'v': return Set{'\v'};
+      case 'x': {
+        auto cp = hex_escape();
+        if (!cp) {
+          return std::nullopt;
+        }
+        if (*cp == 0 || *cp >= (UTF8 ? 0x110000 : 0x80)) {
+          return fail("Escaped character out of the machine's range");
+        }
+        return Set{*cp};
+      }
+      case 'p':
+      case 'P': {
+        auto set = unicode_class();
+        if (!set) {
+          return std::nullopt;
+        }
+        return c == 'p' ? *set : complement(fold(*set));
+      }
+      default:
+        if (std::isalnum((unsigned char)c)) {
+          m_pos--;
+          return fail("Unknown escape sequence");
+        }
+        return Set{(char32_t)c};
+    }
+  }
+
+  ///
+  /// A bracketed class, after the '['
+  ///
+  std::optional<Set> bracket() {
+    bool const negated = accept('^');
+    Set set;
+    bool first = true;
+    while (true) {
+      if (done()) {
+        return fail("Unterminated character class");
+      }
+      if (peek() == ']' && !first) {
+        m_pos++;
+        break;
+      }
+      first = false;
+
+      std::optional<char32_t> low;
+      if (accept('\\')) {
+        auto escaped = escape();
+        if (!escaped) {
+          return std::nullopt;
+        }
+        if (escaped->size() != 1) {
+          set.insert(set.end(), escaped->begin(), escaped->end());
+          continue;
+        }
+        low = escaped->front();
+      } else {
+        low = literal();
+        if (!low) {
+          return std::nullopt;
+        }
+      }
+
+      // a range, unless the '-' closes the class
+      if (m_pos + 1 < m_pattern.size() && peek() == '-' && m_pattern[m_pos + 1] != ']') {
+        m_pos++;
+        std::optional<char32_t> high;
+        if (accept('\\')) {
+          auto escaped = escape();
+          if (!escaped) {
+            return std::nullopt;
+          }
+          if (escaped->size() != 1) {
+            return fail("A class cannot bound a range");
+          }
+          high = escaped->front();
+        } else {
+          high = literal();
+          if (!high) {
+            return std::nullopt;
+          }
+        }
+        if (*high < *low) {
+          return fail("Inverted range within a character class");
+        }
+        add_range(set, *low, *high);
+      } else {
+        set.push_back(*low);
+      }
+    }
+    // the folded set is complemented, so that no case of an excluded character is matched
+    set = fold(normalize(set));
+    return negated ? complement(set) : set;
+  }
+
+  std::optional<Fragment> atom() {
+    char const c = peek();
+    switch (c) {
+      case '(': {
+        m_pos++;
+        std::optional<size_t> group;
+        if (accept('?')) {
+          if (!accept(':')) {
+            return fail("Only (?:...) groups and a leading (?i) are supported");
+          }
+        } else {
+          if (m_captures == Machine_T::MAX_CAPTURE_GROUPS) {
+            return fail("Too many capture groups");
+          }
+          group = m_captures++;
+        }
+
+        if (m_depth == Regex<Machine_T>::MAX_GROUP_DEPTH) {
+          return fail("Groups are nested too deeply");
+        }
+        m_depth++;
+        auto inner = alternation();
+        m_depth--;
+        if (!inner) {
+          return std::nullopt;
+        }
+        if (!accept(')')) {
+          return fail("Expected ')'");
+        }
+        if (!group || !inner->has_content) {
+          return inner;
+        }
+
+        auto const open  = add_state();
+        auto const close = add_state();
+        m_states[open].capture_open   = 1 << *group;
+        m_states[close].capture_close = 1 << *group;
+        link(open, inner->start);
+        link(inner->end, close);
+        return Fragment{open, close, inner->first, m_states.size(), true};
+      }
+      case '[': {
+        m_pos++;
+        auto set = bracket();
+        if (!set) {
+          return std::nullopt;
+        }
+        if (set->empty()) {
+          return fail("Empty character class");
+        }
+        return one_of(*set);
+      }
+      case '.': {
+        m_pos++;
+        return one_of(complement({'\n'}));
+      }
+      case '\\': {
+        m_pos++;
+        auto set = escape();
+        if (!set) {
+          return std::nullopt;
+        }
+        return one_of(fold(*set));
+      }
+      case '^':
+      case '$': return fail("Anchors are only supported at the start and end of a pattern");
+      case '*':
+      case '+':
+      case '?':
+      case '{': return fail("Nothing to repeat");
+      case ')': return fail("Unmatched ')'");
+      default: {
+        auto cp = literal();
+        if (!cp) {
+          return std::nullopt;
+        }
+        return one_of(fold(Set{*cp}));
+      }
+    }
+  }
+
+  std::optional<size_t> number() {
+    size_t value    = 0;
+    size_t const at = m_pos;
+    while (!done() && std::isdigit((unsigned char)peek())) {
+      // saturates past the largest repetition count, so a long number cannot overflow
+      value = std::min(value * 10 + (peek() - '0'), Regex<Machine_T>::MAX_REPEAT_COUNT + 1);
+      m_pos++;
+    }
+    if (m_pos == at) {
+      return std::nullopt;
+    }
+    return value;
+  }
+
+  std::optional<Fragment> repeat(Fragment f, size_t min, size_t max) {
+    if (accept('?')) {
+      return fail("Lazy quantifiers are not supported, matches are always the longest");
+    }
+    if (!f.has_content) {
+      return f;
+    }
+    if (max == 0) {
+      return empty();
+    }
+
+    // every repetition is a copy of the fragment, the required ones in sequence, followed by either a loop over
+    // one more copy, or a chain of optional copies each of which may skip to the end
+    bool const unbounded = max == Machine_T::UNBOUNDED;
+    auto const copies    = unbounded ? min + 1 : max;
+    if (m_states.size() + (copies - 1) * (f.last - f.first) > Regex<Machine_T>::MAX_PATTERN_STATES) {
+      return fail("The pattern is too large");
+    }
+    std::vector<Fragment> parts = {f};
+    for (size_t i = 1; i < copies; i++) {
+      parts.push_back(clone(f));
+    }
+
+    auto const start = add_state();
+    auto const end   = add_state();
+    size_t at        = start;
+    for (size_t i = 0; i < copies; i++) {
+      if (i >= min) {
+        link(at, end);
+      }
+      link(at, parts[i].start);
+      at = parts[i].end;
+    }
+    if (unbounded) {
+      link(at, parts.back().start);
+    }
+    link(at, end);
+    return Fragment{start, end, f.first, m_states.size(), true};
+  }
+
+  std::optional<Fragment> quantified() {
+    auto f = atom();
+    while (f && !done()) {
+      constexpr size_t UNBOUNDED = Machine_T::UNBOUNDED;
+      if (accept('*')) {
+        f = repeat(std::move(*f), 0, UNBOUNDED);
+      } else if (accept('+')) {
+        f = repeat(std::move(*f), 1, UNBOUNDED);
+      } else if (accept('?')) {
+        f = repeat(std::move(*f), 0, 1);
+      } else if (accept('{')) {
+        auto min = number();
+        if (!min) {
+          return fail("Expected a repetition count");
+        }
+        size_t max = *min;
+        if (accept(',')) {
+          auto upper = number();
+          max        = upper ? *upper : UNBOUNDED;
+        }
+        if (!accept('}')) {
+          return fail("Expected '}'");
+        }
+        if (max < *min) {
+          return fail("Invalid repetition bounds");
+        }
+        if (*min > Regex<Machine_T>::MAX_REPEAT_COUNT ||
+            (max != UNBOUNDED && max > Regex<Machine_T>::MAX_REPEAT_COUNT)) {
+          return fail("Repetition count is too large");
+        }
+        f = repeat(std::move(*f), *min, max);
+      } else {
+        break;
+      }
+    }
+    return f;
+  }
+
+  std::optional<Fragment> concatenation() {
+    std::vector<Fragment> parts;
+    while (!done() && peek() != '|' && peek() != ')') {
+      if (peek() == '$' && m_pos + 1 == m_pattern.size()) {
+        break;
+      }
+      auto f = quantified();
+      if (!f) {
+        return std::nullopt;
+      }
+      if (f->has_content) {
+        parts.push_back(*f);
+      }
+    }
+
+    if (parts.empty()) {
+      return empty();
+    }
+    auto out = parts.front();
+    for (size_t i = 1; i < parts.size(); i++) {
+      out = concatenate(out, parts[i]);
+    }
+    return out;
+  }
+
+  std::optional<Fragment> alternation() {
+    std::vector<Fragment> alternatives;
+    do {
+      auto f = concatenation();
+      if (!f) {
+        return std::nullopt;
+      }
+      alternatives.push_back(*f);
+    } while (accept('|'));
+
+    if (alternatives.size() == 1) {
+      return alternatives.front();
+    }
+    m_top_level_alternation = m_top_level_alternation || m_depth == 0;
+
+    auto const start = add_state();
+    auto const end   = add_state();
+    bool has_content = false;
+    for (auto const& alternative : alternatives) {
+      // an empty alternative makes the whole alternation optional
+      if (!alternative.has_content) {
+        link(start, end);
+        continue;
+      }
+      has_content = true;
+      link(start, alternative.start);
+      link(alternative.end, end);
+    }
+    return Fragment{start, end, alternatives.front().first, m_states.size(), has_content};
+  }
+
+public:
+  explicit RegexParser(std::string_view pattern) : m_pattern(pattern) {
+  }
+
+  Regex<Machine_T> compile() {
+    Regex<Machine_T> regex;
+
+    if (m_pattern.starts_with("(?i)")) {
+      m_folding = UTF8 ? CaseFolding::Unicode : CaseFolding::Ascii;
+      m_pos     = 4;
+    }
+    regex.m_anchored_begin = accept('^');
+
+    auto f = alternation();
+    if (f && !done()) {
+      if (accept('$') && done()) {
+        regex.m_anchored_end = true;
+      } else {
+        f = fail(peek() == ')' ? "Unmatched ')'" : "Anchors are only supported at the start and end of a pattern");
+      }
+    }
+    if (f && (regex.m_anchored_begin || regex.m_anchored_end) && m_top_level_alternation) {
+      // '^a|b' anchors only its first alternative, which a whole-pattern anchor cannot express
+      f = fail("Anchors cannot be combined with alternation, wrap the alternation in a group");
+    }
+    if (f && !f->has_content) {
+      f = fail("The pattern only matches the empty string");
+    }
+
+    if (!f) {
+      regex.m_error        = m_error;
+      regex.m_error_offset = m_error_offset;
+      return regex;
+    }
+
+    m_states[f->end].accepting = true;
+    regex.m_machine            = Machine_T::from_automaton(closure({f->start}), [&](States const& states) {
+      return expand(states);
+    });
+    regex.m_captures           = m_captures;
+    if (m_expanded > Regex<Machine_T>::MAX_MACHINE_STATES) {
+      fail("The pattern determinizes into too many states");
+      regex.m_machine      = Machine_T();
+      regex.m_error        = m_error;
+      regex.m_error_offset = m_error_offset;
+    }
+    return regex;
+  }
+};
+
+} // namespace internal
+
+///
+/// Compile a textual pattern into a machine, see Regex for the supported syntax
+///
+/// syntax errors are reported through Regex::is_error() and Regex::error_message()
+///
+template <typename Machine_T = StateMachine<void, char>> Regex<Machine_T> compile_regex(std::string_view pattern) {
+  return internal::RegexParser<Machine_T>(pattern).compile();
+}
+
+///
+/// Compiled patterns, keyed by their text
+///
+/// once 'capacity' patterns are held, the cache is cleared before the next one is added, the patterns are shared,
+/// so those still in use outlive the clear
+///
+/// NOTE: the cache is not thread safe
+///
+template <typename Machine_T = StateMachine<void, char>> class RegexCache {
+  std::unordered_map<std::string, std::shared_ptr<Regex<Machine_T> const>> m_entries;
+  size_t m_capacity;
+
+  size_t m_hits    = 0;
+  size_t m_misses  = 0;
+  size_t m_flushes = 0;
+
+public:
+  struct cache_stats_t {
+    size_t entries; // patterns currently cached
+    size_t hits;    // lookups served from the cache
+    size_t misses;  // lookups which compiled their pattern
+    size_t flushes; // times the cache was full and had to be cleared
+  };
+
+  explicit RegexCache(size_t capacity = 256) : m_capacity(std::max<size_t>(capacity, 1)) {
+  }
+
+  std::shared_ptr<Regex<Machine_T> const> get(std::string_view pattern) {
+    if (auto found = m_entries.find(std::string(pattern)); found != m_entries.end()) {
+      m_hits++;
+      return found->second;
+    }
+
+    m_misses++;
+    if (m_entries.size() >= m_capacity) {
+      m_entries.clear();
+      m_flushes++;
+    }
+    auto compiled = std::make_shared<Regex<Machine_T> const>(compile_regex<Machine_T>(pattern));
+    m_entries.emplace(std::string(pattern), compiled);
+    return compiled;
+  }
+
+  cache_stats_t cache_stats() const {
+    return {m_entries.size(), m_hits, m_misses, m_flushes};
+  }
+
+  void clear() {
+    m_entries.clear();
+  }
+};
+
+}; // namespace regex_backend
@@ -19,6 +19,8 @@
 // OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
+#pragma once
+
 #include "./state_machine_internal/builder.h"
 #include "./state_machine_internal/node.h"
 #include "./util/sets.h"
@@ -27,27 +29,50 @@
 namespace regex_backend {
 
 using MatchErrorMode = internal::MatchErrorMode;
+using StateOrder     = internal::StateOrder;
+using CaseFolding    = internal::CaseFolding;
+
+///
+/// Instrumentation policies for the match functions, pass MatchStats as the Stats_T argument
+/// to collect counters readable through stats(), the default NoMatchStats compiles them out entirely
+///
+using MatchStats         = internal::MatchStats;
+using NoMatchStats       = internal::NoMatchStats;
+using MatchStatsSnapshot = internal::MatchStatsSnapshot;
+
+using MemoryUsage       = internal::MemoryUsage;
+using OptimizePassTrace = internal::OptimizePassTrace;
 
 template <typename Value_T,
           typename Transition_T,
           MatchErrorMode em             = MatchErrorMode::Return,
-          std::size_t STATIC_NODE_COUNT = 0>
+          std::size_t STATIC_NODE_COUNT = 0,
+          typename Stats_T              = NoMatchStats>
 class StateMachine :
     public internal::StateMachine<Value_T,
                                   Transition_T,
-                                  StateMachine<Value_T, Transition_T, em, STATIC_NODE_COUNT>,
+                                  StateMachine<Value_T, Transition_T, em, STATIC_NODE_COUNT, Stats_T>,
                                   STATIC_NODE_COUNT,
-                                  em> {};
+                                  em,
+                                  Stats_T> {};
 
 ///
 /// Specialization of the StateMachine for char- transitions, which provides many useful matches for various char ranges
 ///
-template <typename Value_T, MatchErrorMode em, std::size_t STATIC_NODE_COUNT>
-class StateMachine<Value_T, char, em, STATIC_NODE_COUNT> :
-    public internal::
-        StateMachine<Value_T, char, StateMachine<Value_T, char, em, STATIC_NODE_COUNT>, STATIC_NODE_COUNT, em> {
-  using Parent =
-      internal::StateMachine<Value_T, char, StateMachine<Value_T, char, em, STATIC_NODE_COUNT>, STATIC_NODE_COUNT, em>;
+template <typename Value_T, MatchErrorMode em, std::size_t STATIC_NODE_COUNT, typename Stats_T>
+class StateMachine<Value_T, char, em, STATIC_NODE_COUNT, Stats_T> :
+    public internal::StateMachine<Value_T,
+                                  char,
+                                  StateMachine<Value_T, char, em, STATIC_NODE_COUNT, Stats_T>,
+                                  STATIC_NODE_COUNT,
+                                  em,
+                                  Stats_T> {
+  using Parent = internal::StateMachine<Value_T,
+                                        char,
+                                        StateMachine<Value_T, char, em, STATIC_NODE_COUNT, Stats_T>,
+                                        STATIC_NODE_COUNT,
+                                        em,
+                                        Stats_T>;
 
 public:
   StateMachine& match_any_of(std::string const& options) {
@@ -76,6 +101,19 @@ public:
     return *this;
   }
 
+  ///
+  /// Case-folding variants, these override the machine's case_folding() setting for a single call
+  ///
+  StateMachine& match_any_of(std::string const& options, CaseFolding folding) {
+    Parent::match_any_of(std::vector<char>(options.begin(), options.end()), folding);
+    return *this;
+  }
+
+  StateMachine& match_sequence(std::string const& seq, CaseFolding folding) {
+    Parent::match_sequence(std::vector<char>(seq.begin(), seq.end()), folding);
+    return *this;
+  }
+
   ///
   /// Matches visual whitespace characters
   /// defined at https://en.wikipedia.org/wiki/Whitespace_character
@@ -156,13 +194,21 @@ public:
 /// essentially encodes utf8 chars as a series of simple transitions, but also
 /// introduces logic for dealing with illegal utf8, and stores it in a slightly more compact format
 ///
-template <typename Value_T, MatchErrorMode em, std::size_t STATIC_NODE_COUNT>
-class StateMachine<Value_T, char32_t, em, STATIC_NODE_COUNT> :
-    public internal::
-        StateMachine<Value_T, char32_t, StateMachine<Value_T, char32_t, em, STATIC_NODE_COUNT>, STATIC_NODE_COUNT, em> {
+template <typename Value_T, MatchErrorMode em, std::size_t STATIC_NODE_COUNT, typename Stats_T>
+class StateMachine<Value_T, char32_t, em, STATIC_NODE_COUNT, Stats_T> :
+    public internal::StateMachine<Value_T,
+                                  char32_t,
+                                  StateMachine<Value_T, char32_t, em, STATIC_NODE_COUNT, Stats_T>,
+                                  STATIC_NODE_COUNT,
+                                  em,
+                                  Stats_T> {
 private:
-  using Parent = internal::
-      StateMachine<Value_T, char32_t, StateMachine<Value_T, char32_t, em, STATIC_NODE_COUNT>, STATIC_NODE_COUNT, em>;
+  using Parent = internal::StateMachine<Value_T,
+                                        char32_t,
+                                        StateMachine<Value_T, char32_t, em, STATIC_NODE_COUNT, Stats_T>,
+                                        STATIC_NODE_COUNT,
+                                        em,
+                                        Stats_T>;
 
   std::vector<char32_t> split_str_as_utf_points(std::string const& s) {
     std::vector<char32_t> data;
@@ -225,6 +271,19 @@ public:
     return *this;
   }
 
+  ///
+  /// Case-folding variants, these override the machine's case_folding() setting for a single call
+  ///
+  StateMachine& match_any_of(std::string const& options, CaseFolding folding) {
+    Parent::match_any_of(split_str_as_utf_points(options), folding);
+    return *this;
+  }
+
+  StateMachine& match_sequence(std::string const& seq, CaseFolding folding) {
+    Parent::match_sequence(split_str_as_utf_points(seq), folding);
+    return *this;
+  }
+
   ///
   /// Matches visual whitespace characters
   /// defined at https://en.wikipedia.org/wiki/Whitespace_character
@@ -22,15 +22,30 @@
 
 #pragma once
 
+#include "./case_fold.h"
 #include "./node.h"
 #include "./node_store.h"
+#include "./memory_usage.h"
+#include "./stats.h"
 #include "mutils/assert.h"
 #include "mutils/panic.h"
 #include "mutils/stringify.h"
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
 #include <concepts>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <ranges>
 #include <span>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
@@ -42,17 +57,44 @@ enum ConflictAction {
   Error
 };
 
+///
+/// The order in which optimize() numbers the states of a machine
+///
+enum class StateOrder {
+  Creation,     /// Keep the order in which the builder created the states
+  BreadthFirst, /// Number states level by level from the root
+  DepthFirst    /// Follow each path as deeply as possible, which lays out sequences as consecutive states
+};
+
 enum class MatchErrorMode {
   Panic, /// Print an error message to stderr and exit the program
   Return /// Includes error info within the return values of match functions
 };
 
+///
+/// A record of a single optimize() pass, delivered to the sink set with trace_optimize()
+///
+struct OptimizePassTrace {
+  char const* pass;                     // name of the pass function
+  std::chrono::nanoseconds wall_time{}; // time spent within the pass
+  size_t nodes_before    = 0;           // non-null nodes before the pass ran
+  size_t nodes_after     = 0;           // non-null nodes once the pass finished
+  size_t iterations      = 0;           // rounds taken by the pass to reach a fixpoint, 1 for single sweeps
+  size_t bytes_allocated = 0;           // bytes of scratch buffers and node tables allocated by the pass
+};
+
+using OptimizeTraceSink = std::function<void(OptimizePassTrace const&)>;
+
 ///
 /// Here we hold state exclusive to constructible / dynamically allocated state machines
 ///
 template <bool IS_DYNAMIC> struct StateMachineConstructionState {
   ConflictAction on_conflict  = ConflictAction::Error;
+  CaseFolding case_folding    = CaseFolding::None;
   std::vector<size_t> cursors = {1};
+
+  OptimizeTraceSink trace_sink;
+  size_t scratch_bytes = 0; // allocations made by the running optimize() pass, only maintained while tracing
 };
 
 template <> struct StateMachineConstructionState<false> {};
@@ -63,8 +105,9 @@ template <typename Value_T,                  // Type of values held at regex loo
           std::size_t STATIC_NODE_COUNT = 0, // The number of internal nodes when allocating statically, set to 0 for
                                              // dynamic allocation or to any integer for static allocation
           MatchErrorMode ON_MATCH_ERROR =
-              MatchErrorMode::Return // The behavior of unrecoverable match errors, such as malformed utf8 sequences
-                                     // This does NOT influence the match result for the case of no match
+              MatchErrorMode::Return, // The behavior of unrecoverable match errors, such as malformed utf8 sequences
+                                      // This does NOT influence the match result for the case of no match
+          typename Stats_T = NoMatchStats // Instrumentation policy for the match functions, see stats.h
           >
 class StateMachine {
 
@@ -85,17 +128,28 @@ class StateMachine {
 
   StateMachineConstructionState<!IS_PREALLOCATED> construction_state;
 
+  [[no_unique_address]] Stats_T m_stats;
+
+  template <typename, typename, typename, std::size_t, MatchErrorMode, typename> friend class StateMachine;
+
 public:
   using MutableRegex = StateMachine<void, Transition_T, Self, 0, ON_MATCH_ERROR>;
   // using Self_T = Self;
   typedef Self Self_T;
 
+  // An upper bound for match_repeat() without a limit
+  static constexpr size_t UNBOUNDED = std::numeric_limits<size_t>::max();
+
+  // The number of capture groups a machine may hold, see open_capture()
+  static constexpr size_t MAX_CAPTURE_GROUPS = 16;
+
   ///
   /// Construct a static state-machine from a pre-existing dynamic one
   ///
   /// Note: You must know the size of the dynamic state machine to construct this
-  constexpr StateMachine(StateMachine<Value_T, Transition_T, Self, 0, ON_MATCH_ERROR> from)
-    requires(IS_PREALLOCATED)
+  template <std::size_t FROM_NODE_COUNT>
+  constexpr StateMachine(StateMachine<Value_T, Transition_T, Self, FROM_NODE_COUNT, ON_MATCH_ERROR, Stats_T> const& from)
+    requires(IS_PREALLOCATED && FROM_NODE_COUNT == 0)
   {
     MUTILS_ASSERT_EQ(
         from.m_nodes.size(),
@@ -128,6 +182,16 @@ public:
     return *(Self*)this;
   }
 
+  ///
+  /// Set the case folding applied by every following match_any_of() / match_sequence() call
+  ///
+  Self& case_folding(CaseFolding folding)
+    requires IS_DYNAMIC
+  {
+    construction_state.case_folding = folding;
+    return *(Self*)this;
+  }
+
   Self& match_default()
     requires IS_DYNAMIC
   {
@@ -174,9 +238,15 @@ public:
 
   Self& match_sequence(std::vector<Transition_T> seq)
     requires IS_DYNAMIC
+  {
+    return match_sequence(std::move(seq), construction_state.case_folding);
+  }
+
+  Self& match_sequence(std::vector<Transition_T> seq, CaseFolding folding)
+    requires IS_DYNAMIC
   {
     for (auto part : seq) {
-      match_any_of({part});
+      match_any_of({part}, folding);
     }
     return *(Self*)this;
   }
@@ -184,10 +254,21 @@ public:
   Self& match_any_of(std::vector<Transition_T> options)
     requires IS_DYNAMIC
   {
+    return match_any_of(std::move(options), construction_state.case_folding);
+  }
+
+  Self& match_any_of(std::vector<Transition_T> options, CaseFolding folding)
+    requires IS_DYNAMIC
+  {
+    options      = case_variants(options, folding);
     auto& target = new_node();
     auto tidx    = node_index(target);
     std::vector<size_t> new_cursors;
     auto initial_cursors = construction_state.cursors;
+
+    // the nodes cloned by every choice, and the leading key each choice transitions on
+    std::vector<std::pair<size_t, size_t>> clones;
+    std::vector<typename Node_T::Key_T> leading_keys;
     for (auto choice : options) {
 
       if constexpr (IS_UTF8) {
@@ -204,34 +285,51 @@ public:
 
         if (key & (byte << 24)) {
           // 4-wide utf8 char
-          cursor_discreet_transition(Node_T::Key_T::value((key >> 24) & drop_mask));
-          cursor_discreet_transition(Node_T::Key_T::value((key >> 16) & drop_mask));
-          cursor_discreet_transition(Node_T::Key_T::value((key >> 8) & drop_mask));
-          cursor_discreet_transition(Node_T::Key_T::value(key & drop_mask));
+          cursor_discreet_transition(Node_T::Key_T::value((key >> 24) & drop_mask), clones);
+          cursor_discreet_transition(Node_T::Key_T::value((key >> 16) & drop_mask), clones);
+          cursor_discreet_transition(Node_T::Key_T::value((key >> 8) & drop_mask), clones);
+          cursor_discreet_transition(Node_T::Key_T::value(key & drop_mask), clones);
 
         } else if (key & (byte << 16)) {
           // 3-wide utf8 char
-          cursor_discreet_transition(Node_T::Key_T::value((key >> 16) & drop_mask));
-          cursor_discreet_transition(Node_T::Key_T::value((key >> 8) & drop_mask));
-          cursor_discreet_transition(Node_T::Key_T::value(key & drop_mask));
+          cursor_discreet_transition(Node_T::Key_T::value((key >> 16) & drop_mask), clones);
+          cursor_discreet_transition(Node_T::Key_T::value((key >> 8) & drop_mask), clones);
+          cursor_discreet_transition(Node_T::Key_T::value(key & drop_mask), clones);
         } else if (key & (byte << 8)) {
           // 2-wide utf8 char
-          cursor_discreet_transition(Node_T::Key_T::value((key >> 8) & drop_mask));
-          cursor_discreet_transition(Node_T::Key_T::value(key & drop_mask));
+          cursor_discreet_transition(Node_T::Key_T::value((key >> 8) & drop_mask), clones);
+          cursor_discreet_transition(Node_T::Key_T::value(key & drop_mask), clones);
         } else {
           // 1-wide utf8 char  / treat as regular ascii character
           MUTILS_ASSERT((key & 128) == 0, "The MSB was found to be set in an ascii character");
-          cursor_discreet_transition(Node_T::Key_T::value(key));
+          cursor_discreet_transition(Node_T::Key_T::value(key), clones);
         }
       } else {
 
-        cursor_discreet_transition(Node_T::Key_T::value(choice));
+        cursor_discreet_transition(Node_T::Key_T::value(choice), clones);
       }
       // gather all the new cursors
       std::for_each(construction_state.cursors.begin(), construction_state.cursors.end(), [&](auto c) {
         new_cursors.push_back(c);
       });
       construction_state.cursors = initial_cursors;
+      leading_keys.push_back(leading_key(choice));
+    }
+
+    //
+    // A clone of a cursor continues wherever that cursor now continues
+    // if this did not happen, a cursor reached through another cursor would keep its old transitions in the clone,
+    // so for instance a*a would reach a non-accepting state on "aa", and a{1,2}[ab] would reject "aab"
+    //
+    for (auto [clone, source] : clones) {
+      if (std::find(initial_cursors.begin(), initial_cursors.end(), source) == initial_cursors.end()) {
+        continue;
+      }
+      for (auto key : leading_keys) {
+        if (auto const to = get_node(source).transition(key)) {
+          get_node(clone).transition(key) = to;
+        }
+      }
     }
     construction_state.cursors = new_cursors;
     return *(Self*)this;
@@ -248,6 +346,94 @@ public:
     return match(pattern).match_many_optionally(pattern);
   }
 
+  ///
+  /// Match the pattern between min and max times (inclusive), max may be UNBOUNDED
+  ///
+  /// the pattern is merged into the machine once per repetition, so the machine grows linearly with max:
+  /// the first min repetitions in sequence, and the remaining ones as a chain of early exits
+  ///
+  Self& match_repeat(MutableRegex pattern, size_t min, size_t max)
+    requires IS_DYNAMIC
+  {
+    if (max < min) {
+      mutils::PANIC("Invalid repetition bounds: {" + std::to_string(min) + "," + std::to_string(max) + "}");
+    }
+
+    for (size_t i = 0; i < min; i++) {
+      merge_regex_into_machine(pattern);
+    }
+
+    if (max == UNBOUNDED) {
+      return match_many_optionally(pattern);
+    }
+
+    // every optional repetition continues from the previous one, while its entry points remain exits
+    // as do the nodes merged with those entry points
+    auto exits = construction_state.cursors;
+    for (size_t i = min; i < max; i++) {
+      merge_regex_into_machine(pattern, &exits);
+      for (auto c : construction_state.cursors) {
+        exits.push_back(c);
+      }
+    }
+    std::sort(exits.begin(), exits.end());
+    exits.erase(std::unique(exits.begin(), exits.end()), exits.end());
+    construction_state.cursors = exits;
+    return *(Self*)this;
+  }
+
+  ///
+  /// Match the pattern exactly n times
+  ///
+  Self& match_repeat(MutableRegex pattern, size_t n)
+    requires IS_DYNAMIC
+  {
+    return match_repeat(std::move(pattern), n, n);
+  }
+
+  ///
+  /// Begin capture group 'group' at the current cursors
+  ///
+  /// captures are tags on the states of the machine, find_captures() records the input offset whenever it enters
+  /// a tagged state, so the submatches are extracted within the same single pass as the match itself
+  ///
+  /// NOTE: a capture boundary is only exact when the states it is placed on are not shared with differently
+  /// tagged paths, merging two such paths keeps the tags of both
+  ///
+  Self& open_capture(size_t group)
+    requires IS_DYNAMIC
+  {
+    auto const bit = capture_bit(group);
+    for (auto c : construction_state.cursors) {
+      get_node(c).capture_open |= bit;
+    }
+    return *(Self*)this;
+  }
+
+  ///
+  /// End capture group 'group' at the current cursors
+  ///
+  Self& close_capture(size_t group)
+    requires IS_DYNAMIC
+  {
+    auto const bit = capture_bit(group);
+    for (auto c : construction_state.cursors) {
+      get_node(c).capture_close |= bit;
+    }
+    return *(Self*)this;
+  }
+
+  ///
+  /// Match the pattern as capture group 'group'
+  ///
+  Self& capture(size_t group, MutableRegex pattern)
+    requires IS_DYNAMIC
+  {
+    open_capture(group);
+    merge_regex_into_machine(pattern);
+    return close_capture(group);
+  }
+
   Self& match_many_optionally(MutableRegex pattern)
     requires IS_DYNAMIC
   {
@@ -256,6 +442,17 @@ public:
     auto res             = consume_regex_except_root(pattern);
     Node_T& pattern_root = pattern.m_nodes[0];
 
+    // every entry into the cycle passes through the pattern's root, and so do its captures
+    for (auto entry : cursors_before) {
+      get_node(entry).capture_open |= pattern_root.capture_open;
+      get_node(entry).capture_close |= pattern_root.capture_close;
+    }
+    for (auto terminal : res.terminals) {
+      get_node(terminal).capture_open |= pattern_root.capture_open;
+      get_node(terminal).capture_close |= pattern_root.capture_close;
+    }
+
+    merged_nodes merged;
     pattern_root.each_transition([&](auto key, auto& old_transition) {
       auto new_transition = res.mappings[old_transition];
 
@@ -265,26 +462,29 @@ public:
       // this is done by treating all of the terminals as the original root
       // referring back into the graph
       for (auto terminal : res.terminals) {
-        make_nonambiguous_link(terminal, key, new_transition, {});
+        link_merged(terminal, key, new_transition, merged);
       }
-    });
 
-    pattern_root.each_transition([&](auto key, auto& old_transition) {
-      auto new_transition = res.mappings[old_transition];
       //
       // write the transitions into the cycle to make it accessible
       //
-      for (auto terminal : cursors_before) {
-        make_nonambiguous_link(terminal, key, new_transition, {});
+      for (auto entry : cursors_before) {
+        link_merged(entry, key, new_transition, merged);
       }
     });
+    fill_merged(merged);
 
+    // every node merged with a cursor or a terminal is itself a place the cycle may be left from
+    std::vector<size_t> exits = cursors_before;
+    for (auto t : res.terminals) {
+      exits.push_back(t);
+    }
+    for (auto n : merged.containing(exits)) {
+      exits.push_back(n);
+    }
 
     // finally, we preserve the original cursors
-    construction_state.cursors = cursors_before;
-    for (auto c : res.terminals) {
-      construction_state.cursors.push_back(c);
-    }
+    construction_state.cursors = exits;
 
     return *(Self*)this;
   }
@@ -344,6 +544,98 @@ public:
     return *(Self*)this;
   };
 
+  ///
+  /// Set an exit point holding 'value' for a state machine with values, such as a dictionary
+  ///
+  /// the 'back_by' parameter behaves as for regex state machines
+  ///
+  template <typename V = Value_T>
+  Self& exit_point(std::type_identity_t<V> const& value, size_t back_by = 0)
+    requires(HAS_VALUE && IS_DYNAMIC)
+  {
+    typename Node_T::Value_T const exit{value, back_by};
+
+    std::vector<std::string> errors;
+    for (auto cur : construction_state.cursors) {
+      Node_T& node = get_node(cur);
+
+      if (node.value.has_value() && !(node.value.value() == exit)) {
+        // Collision
+        switch (construction_state.on_conflict) {
+          case ConflictAction::Skip: continue;
+          case ConflictAction::Overwrite: break;
+          case ConflictAction::Error: {
+            errors.push_back("In node #" + std::to_string(cur) +
+                             ", the existing exit point was attempted to be replaced with a different value");
+            continue;
+          }
+        }
+      }
+      node.value = exit;
+    }
+
+    // Error alerting
+    if (errors.size()) {
+      std::string msg = "An error was encountered while generating an exit-point to a state machine\n";
+      for (auto e : errors) {
+        msg += e + "\n";
+      }
+      msg += "\nTo solve these errors, either make non-ambiguous state machines, or update the conflict behavior";
+      mutils::PANIC(msg);
+    }
+
+    return *(Self*)this;
+  };
+
+  ///
+  /// The number of nodes currently held by the machine, including the root
+  /// and any nullified nodes which have not yet been removed by optimize()
+  ///
+  std::size_t node_count() const {
+    return m_nodes.size();
+  }
+
+  ///
+  /// A breakdown of the memory held by the machine, see MemoryUsage
+  ///
+  MemoryUsage memory_usage() const {
+    MemoryUsage usage;
+    usage.node_count = m_nodes.size();
+
+    size_t heap_bytes = 0;
+    ByteClassCounter<typename Node_T::ValueKey_T> classes;
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+      auto const& node = m_nodes[i];
+      usage.transition_bytes += node.transition_bytes();
+      usage.value_bytes += sizeof(node.value);
+      usage.transition_slots += node.transition_slots();
+      usage.nonzero_transitions += node.nonzero_transitions();
+      heap_bytes += node.transition_heap_bytes();
+
+      auto const def = node.default_target();
+      node.each_value_transition([&](auto key, size_t to) {
+        if (to != def) {
+          classes.add(key, i + 1, to);
+        }
+      });
+    }
+    usage.byte_classes = classes.count(Node_T::KEYSPACE);
+
+    // whatever the transitions and value leave of each node is padding
+    size_t const padding = sizeof(Node_T) * m_nodes.size() - (usage.transition_bytes - heap_bytes) - usage.value_bytes;
+    usage.overhead_bytes = padding + m_stats.heap_bytes();
+
+    if constexpr (IS_DYNAMIC) {
+      usage.construction_bytes = sizeof(construction_state) + construction_state.cursors.capacity() * sizeof(size_t);
+      usage.overhead_bytes += sizeof(*this) - sizeof(construction_state) +
+                              (m_nodes.capacity() - m_nodes.size()) * sizeof(Node_T);
+    } else {
+      // the nodes are held inline, and are already accounted for
+      usage.overhead_bytes += sizeof(*this) - sizeof(m_nodes);
+    }
+    return usage;
+  }
+
   /**
    * Dump a textual representation of the state machine to
    * stdout
@@ -381,89 +673,450 @@ public:
     }
   }
 
-  Self_T& optimize()
+  ///
+  /// Simplify the machine, then renumber its states in the given order
+  ///
+  /// without a profile to relayout() by, the depth first order keeps the states of a matched
+  /// sequence in consecutive rows of the node table, so scanning it touches neighbouring memory
+  ///
+  Self_T& optimize(StateOrder order = StateOrder::DepthFirst)
     requires IS_DYNAMIC
   {
-    nullify_nullrefs();
-    remove_duplicates();
-    nullify_nullrefs();
-    remove_duplicates();
-    nullify_orphans();
-    remove_blanks();
+    run_pass("nullify_nullrefs", [&] { return nullify_nullrefs(); });
+    run_pass("remove_duplicates", [&] { return remove_duplicates(); });
+    run_pass("nullify_nullrefs", [&] { return nullify_nullrefs(); });
+    run_pass("remove_duplicates", [&] { return remove_duplicates(); });
+    run_pass("nullify_orphans", [&] { return nullify_orphans(); });
+    run_pass("remove_blanks", [&] {
+      remove_blanks();
+      return 1;
+    });
     // construction_state.cursors = {1};
 
+    run_pass("relayout", [&] {
+      relayout(order);
+      return 1;
+    });
+
     return *(Self_T*)this;
   }
 
-  ////////////////////////////////////////////////////
-  /// STATE MACHINE LOOKUP / SEARCH FUNCTIONALITIES
-  ////////////////////////////////////////////////////
-
+  ///
+  /// Report every pass of subsequent optimize() calls to 'sink', pass an empty sink to stop tracing
+  ///
+  /// useful for finding patterns which make the builder misbehave, see OptimizePassTrace
+  ///
+  Self& trace_optimize(OptimizeTraceSink sink)
+    requires IS_DYNAMIC
+  {
+    construction_state.trace_sink = std::move(sink);
+    return *(Self*)this;
+  }
 
-  // Return type declarations
+  ///
+  /// Renumber the states of the machine by a traversal from the root
+  ///
+  /// states unreachable from the root (such as blank states held by cursors) are kept at the end
+  ///
+  Self_T& relayout(StateOrder order)
+    requires IS_DYNAMIC
+  {
+    if (order == StateOrder::Creation) {
+      m_stats.resize(m_nodes.size());
+      return *(Self_T*)this;
+    }
 
-  template <typename Val_T> struct _input_t {
-    using type = Val_T;
-  };
+    std::vector<bool> placed(m_nodes.size(), false);
+    std::vector<size_t> numbering;
+    numbering.reserve(m_nodes.size());
+
+    // both traversals share a worklist, consumed from the front for breadth first and from the back for depth first
+    std::vector<size_t> worklist = {1};
+    size_t front                 = 0;
+    std::vector<size_t> children;
+    while (front < worklist.size()) {
+      size_t node;
+      if (order == StateOrder::BreadthFirst) {
+        node = worklist[front++];
+      } else {
+        node = worklist.back();
+        worklist.pop_back();
+      }
 
-  template <> struct _input_t<char32_t> {
-    using type = char;
-  };
+      if (placed[node - 1]) {
+        continue;
+      }
+      placed[node - 1] = true;
+      numbering.push_back(node);
 
-  using input_t = typename _input_t<Transition_T>::type;
+      children.clear();
+      m_nodes[node - 1].each_transition([&](auto, auto& t) {
+        if (!placed[t - 1]) {
+          children.push_back(t);
+        }
+      });
+      if (order == StateOrder::DepthFirst) {
+        // the lowest transition is visited first
+        worklist.insert(worklist.end(), children.rbegin(), children.rend());
+      } else {
+        worklist.insert(worklist.end(), children.begin(), children.end());
+      }
+    }
 
-  template <MatchErrorMode em> struct match_maybe_error_t {
-    constexpr static bool MAYBE_ERROR = false;
-  };
+    for (size_t i = 1; i <= m_nodes.size(); i++) {
+      if (!placed[i - 1]) {
+        numbering.push_back(i);
+      }
+    }
+    note_scratch(placed);
+    note_scratch(numbering);
+    note_scratch(worklist);
 
-  template <> struct match_maybe_error_t<MatchErrorMode::Return> {
-  private:
-    char const* errmsg = nullptr;
+    renumber(numbering);
+    return *(Self_T*)this;
+  }
 
-  public:
-    constexpr static bool MAYBE_ERROR = true;
+  ///
+  /// Renumber the states of the machine by how often they are visited, so that the hottest
+  /// states sit next to each other at the start of the node table, and the cold ones at its end
+  ///
+  /// 'profile' holds a visit count per state, indexed by node index - 1, as produced by
+  /// the MatchStats instrumentation or loaded from a profile collected elsewhere.
+  /// The root always remains the first state, and states not covered by the profile are treated as never visited
+  ///
+  /// NOTE: The profile must describe the current numbering, so relayout after any further optimize() or build
+  /// step requires a fresh profile
+  ///
+  Self_T& relayout(std::span<std::uint64_t const> profile)
+    requires IS_DYNAMIC
+  {
+    auto const visits = [&](size_t node) -> std::uint64_t {
+      return node - 1 < profile.size() ? profile[node - 1] : 0;
+    };
 
-    bool is_error() const {
-      return errmsg != nullptr;
+    std::vector<size_t> order(m_nodes.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i + 1;
     }
+    // cold states keep their relative order, which is what the builder produced
+    std::stable_sort(order.begin() + 1, order.end(), [&](size_t a, size_t b) {
+      return visits(a) > visits(b);
+    });
 
-    char const* error_message() const {
-      return errmsg;
-    }
+    renumber(order);
+    return *(Self_T*)this;
+  }
 
-    match_maybe_error_t(char const* dat) : errmsg(dat){};
-    match_maybe_error_t() : errmsg(nullptr){};
-  };
+  Self_T& relayout(MatchStatsSnapshot const& profile)
+    requires IS_DYNAMIC
+  {
+    return relayout(std::span<std::uint64_t const>(profile.state_visits));
+  }
 
-  using match_maybe_error = match_maybe_error_t<ON_MATCH_ERROR>;
+  ////////////////////////////////////////////////////
+  /// MACHINE COMBINATION
+  ////////////////////////////////////////////////////
 
   ///
-  /// The result of a matched pattern utilizing the find()
-  /// function
+  /// The machine matching every input matched by both this machine and 'other'
   ///
-  template <typename Val_T> struct find_result_t : match_maybe_error {
-    std::span<input_t> range;
-    Val_T const* val;
+  /// the machines are combined state by state (product construction), visiting only the pairs of states reachable
+  /// from the pair of roots, and the result is optimized. Exit points keep the values and back_by of this machine
+  ///
+  /// NOTE: 'matching' refers to matches(), find() on the result locates ranges which both machines match in full
+  ///
+  Self_T intersect(Self_T const& other) const
+    requires IS_DYNAMIC
+  {
+    return product(other, false);
+  }
 
-    ///
-    /// verbose error value constructor
-    ///
-    find_result_t(char const* err)
-      requires match_maybe_error::MAYBE_ERROR
-        : match_maybe_error(err), val(nullptr){};
+  ///
+  /// The machine matching every input matched by this machine, but not by 'other'
+  ///
+  Self_T subtract(Self_T const& other) const
+    requires IS_DYNAMIC
+  {
+    return product(other, true);
+  }
 
-    ///
-    /// error value constructor
-    ///
-    find_result_t()
-      requires(!match_maybe_error::MAYBE_ERROR)
-        : val(nullptr){};
+  ///
+  /// The machine matching every input this machine does not match
+  ///
+  /// the rejected inputs are absorbed by a final state which loops on the default transition, so the complement is
+  /// relative to the whole input alphabet, including the empty input
+  ///
+  Self_T complement() const
+    requires(IS_DYNAMIC && IS_REGEX)
+  {
+    // work on a copy, as the node accessors are not const
+    Self_T source = *(Self_T const*)this;
+    Self_T out;
+    auto& nodes = static_cast<StateMachine&>(out).m_nodes;
+
+    // state 0 of the source stands for the rejecting sink, which becomes accepting
+    std::map<size_t, size_t> index = {{ROOT_STATE, 1}};
+    std::vector<size_t> worklist   = {ROOT_STATE};
+    auto const state_of            = [&](size_t s) {
+      auto [found, inserted] = index.try_emplace(s, nodes.size() + 1);
+      if (inserted) {
+        nodes.push(Node_T());
+        worklist.push_back(s);
+      }
+      return found->second;
+    };
 
-    ///
-    /// value constructor
-    ///
-    find_result_t(std::span<input_t> range, Val_T const* dat) : range(range), val(dat){};
-  };
+    while (!worklist.empty()) {
+      auto const s = worklist.back();
+      worklist.pop_back();
+      auto const idx = index[s];
+
+      bool accepts = true;
+      std::vector<std::pair<typename Node_T::Key_T, size_t>> targets;
+      if (s != 0) {
+        auto& node = source.get_node(s);
+        accepts    = !node.value.has_value();
+        node.each_transition([&](auto k, auto& t) {
+          if (k.is_value()) {
+            targets.emplace_back(k, t);
+          }
+        });
+        targets.emplace_back(Node_T::Key_T::def(), node.transition(Node_T::Key_T::def()));
+        targets.emplace_back(Node_T::Key_T::eof(), node.transition(Node_T::Key_T::eof()));
+      } else {
+        targets.emplace_back(Node_T::Key_T::def(), 0);
+        targets.emplace_back(Node_T::Key_T::eof(), 0);
+      }
+
+      for (auto [key, target] : targets) {
+        auto const to                  = state_of(target);
+        nodes[idx - 1].transition(key) = to;
+      }
+      if (accepts) {
+        nodes[idx - 1].value = Node_Value<void>{0};
+      }
+    }
+
+    out.construction_state.cursors = {ROOT_STATE};
+    out.optimize();
+    return out;
+  }
+
+  ///
+  /// A state of an automaton given to from_automaton()
+  ///
+  template <typename State_T> struct automaton_state {
+    std::optional<Node_Value<Value_T>> exit;
+    // elements with a transition of their own, std::nullopt rejecting the element despite the default transition
+    std::vector<std::pair<Transition_T, std::optional<State_T>>> transitions;
+    std::optional<State_T> fallback; // the default transition
+    std::optional<State_T> eof;
+    std::uint16_t capture_open  = 0; // see open_capture()
+    std::uint16_t capture_close = 0;
+  };
+
+  ///
+  /// Builds the machine of an automaton described state by state, such as the subset construction of an NFA
+  ///
+  /// 'expand(state)' returns the automaton_state of the state, every state reached from 'root' being expanded once,
+  /// states being told apart by their ordering. The result is optimized
+  ///
+  template <typename State_T, typename Expand_F>
+  static Self_T from_automaton(State_T const& root, Expand_F&& expand)
+    requires IS_DYNAMIC
+  {
+    Self_T out;
+    auto& nodes = static_cast<StateMachine&>(out).m_nodes;
+
+    std::map<State_T, size_t> index = {{root, 1}};
+    std::vector<State_T> worklist   = {root};
+    auto const state_of             = [&](State_T const& state) {
+      auto [found, inserted] = index.try_emplace(state, nodes.size() + 1);
+      if (inserted) {
+        nodes.push(Node_T());
+        worklist.push_back(state);
+      }
+      return found->second;
+    };
+
+    // rejected elements lead to a state which rejects anything after them, as a missing transition would fall back
+    // onto the default transition
+    size_t dead         = 0;
+    auto const dead_end = [&]() {
+      if (!dead) {
+        nodes.push(Node_T());
+        dead                                             = nodes.size();
+        nodes[dead - 1].transition(Node_T::Key_T::def()) = dead;
+      }
+      return dead;
+    };
+
+    while (!worklist.empty()) {
+      auto const state = std::move(worklist.back());
+      worklist.pop_back();
+      auto const idx                = index[state];
+      automaton_state<State_T> next = expand(state);
+
+      // the elements of a class lead to the same state, which is only looked up once
+      std::optional<State_T> const* previous = nullptr;
+      size_t to                              = 0;
+      for (auto& [element, target] : next.transitions) {
+        if (!previous || *previous != target) {
+          to       = target ? state_of(*target) : dead_end();
+          previous = &target;
+        }
+        nodes[idx - 1].transition(Node_T::Key_T::value(element)) = to;
+      }
+      if (next.fallback) {
+        auto const to                                   = state_of(*next.fallback);
+        nodes[idx - 1].transition(Node_T::Key_T::def()) = to;
+      }
+      if (next.eof) {
+        auto const to                                   = state_of(*next.eof);
+        nodes[idx - 1].transition(Node_T::Key_T::eof()) = to;
+      }
+      nodes[idx - 1].value         = next.exit;
+      nodes[idx - 1].capture_open  = next.capture_open;
+      nodes[idx - 1].capture_close = next.capture_close;
+    }
+
+    out.construction_state.cursors = {ROOT_STATE};
+    out.optimize();
+    return out;
+  }
+
+  ///
+  /// The machine accepting what any of the patterns accepts, its exit points holding the value paired with the pattern
+  ///
+  /// patterns accepting the same input never conflict: the earliest of them wins, along with its back_by
+  ///
+  template <typename Pattern_T>
+  static Self_T prioritized_union(std::span<std::pair<Pattern_T const*, Value_T> const> patterns)
+    requires(HAS_VALUE && IS_DYNAMIC)
+  {
+    // the state of every pattern, 0 once it rejected the input
+    using Tuple = std::vector<size_t>;
+
+    auto const node = [&](size_t pattern, size_t state) -> auto const& {
+      return patterns[pattern].first->m_nodes[state - 1];
+    };
+
+    return from_automaton(Tuple(patterns.size(), ROOT_STATE), [&](Tuple const& tuple) {
+      automaton_state<Tuple> out;
+      Tuple fallback(tuple.size(), 0);
+      Tuple eof(tuple.size(), 0);
+      for (size_t i = 0; i < tuple.size(); i++) {
+        if (tuple[i] == 0) {
+          continue;
+        }
+        auto const& n = node(i, tuple[i]);
+        if (n.value.has_value() && !out.exit) {
+          out.exit = {patterns[i].second, n.value->back_by};
+        }
+        fallback[i] = n.get_def();
+        eof[i]      = n.get_eof();
+      }
+
+      // an element without a transition of its own falls back onto the default transition of every pattern
+      std::map<Transition_T, Tuple> explicit_targets;
+      for (size_t i = 0; i < tuple.size(); i++) {
+        if (tuple[i] == 0) {
+          continue;
+        }
+        node(i, tuple[i]).each_value_transition([&](auto key, size_t to) {
+          explicit_targets.try_emplace(Transition_T(key), fallback).first->second[i] = to;
+        });
+      }
+
+      auto const live = [](Tuple const& t) {
+        return std::any_of(t.begin(), t.end(), [](size_t s) { return s != 0; });
+      };
+      for (auto& [element, target] : explicit_targets) {
+        if (target != fallback) {
+          out.transitions.emplace_back(element, std::move(target));
+        }
+      }
+      if (live(fallback)) {
+        out.fallback = std::move(fallback);
+      }
+      if (live(eof)) {
+        out.eof = std::move(eof);
+      }
+      return out;
+    });
+  }
+
+  ////////////////////////////////////////////////////
+  /// STATE MACHINE LOOKUP / SEARCH FUNCTIONALITIES
+  ////////////////////////////////////////////////////
+
+
+  // Return type declarations
+
+  template <typename Val_T> struct _input_t {
+    using type = Val_T;
+  };
+
+  template <> struct _input_t<char32_t> {
+    using type = char;
+  };
+
+  using input_t      = typename _input_t<Transition_T>::type;
+  using transition_t = Transition_T;
+  using value_t      = Value_T;
+
+  template <MatchErrorMode em> struct match_maybe_error_t {
+    constexpr static bool MAYBE_ERROR = false;
+  };
+
+  template <> struct match_maybe_error_t<MatchErrorMode::Return> {
+  private:
+    char const* errmsg = nullptr;
+
+  public:
+    constexpr static bool MAYBE_ERROR = true;
+
+    bool is_error() const {
+      return errmsg != nullptr;
+    }
+
+    char const* error_message() const {
+      return errmsg;
+    }
+
+    match_maybe_error_t(char const* dat) : errmsg(dat){};
+    match_maybe_error_t() : errmsg(nullptr){};
+  };
+
+  using match_maybe_error = match_maybe_error_t<ON_MATCH_ERROR>;
+
+  ///
+  /// The result of a matched pattern utilizing the find()
+  /// function
+  ///
+  template <typename Val_T> struct find_result_t : match_maybe_error {
+    std::span<input_t> range;
+    Val_T const* val;
+
+    ///
+    /// verbose error value constructor
+    ///
+    find_result_t(char const* err)
+      requires match_maybe_error::MAYBE_ERROR
+        : match_maybe_error(err), val(nullptr){};
+
+    ///
+    /// error value constructor
+    ///
+    find_result_t()
+      requires(!match_maybe_error::MAYBE_ERROR)
+        : val(nullptr){};
+
+    ///
+    /// value constructor
+    ///
+    find_result_t(std::span<input_t> range, Val_T const* dat) : range(range), val(dat){};
+  };
 
   template <> struct find_result_t<void> : match_maybe_error {
     std::span<input_t> range;
@@ -621,149 +1274,185 @@ public:
   /// returns an empty range if no match could be made
   ///
   find_result find(std::span<input_t> input) const {
-#define err(msg)                                                                                                       \
-  if constexpr (ON_MATCH_ERROR == MatchErrorMode::Panic) mutils::PANIC(msg);                                           \
-  else return {msg};
-
-    size_t current_node               = 1;
-    size_t most_specific_matched_node = 0;
-    size_t match_begin                = 0;
-    size_t match_end                  = 0;
-    utf_validator uv;
-    for (size_t i = 0; i < input.size(); i++) {
-      auto& transition = input[i];
-      auto& node       = m_nodes[current_node - 1];
-
-      if constexpr (IS_UTF8) {
-        auto error = uv.next(transition);
-        if (error != utf_validator::None) {
-          err(utf_validator::err_to_msg(error));
-        }
-      }
-
-
-      auto loc = node.rt_get_transition(transition);
+    return find_impl<false>(input, nullptr);
+  }
 
-      if (loc != 0) {
-        // go one iteration deeper and continue
-        current_node = loc;
+  ///
+  /// The result of find_captures(), holding the match and the submatch of every capture group
+  ///
+  /// groups which did not take part in the match are empty optionals
+  ///
+  struct capture_result {
+    find_result match;
+    std::array<std::optional<std::span<input_t>>, MAX_CAPTURE_GROUPS> groups;
+  };
 
-        // update the most specific node
-        if (m_nodes[current_node - 1].value.has_value()) {
-          most_specific_matched_node = current_node;
-          match_end                  = i + 1;
-        }
-      } else if (most_specific_matched_node == 0) {
-        // reset the current_node, and try to match from scratch
-        current_node = 1;
-        match_begin  = i + 1;
-        match_end    = i + 1;
-        continue;
-      } else if (most_specific_matched_node != 0) {
-        // we have a match, just return that
-        break;
-      }
-    }
+  ///
+  /// Identical to find(), but also extracts the capture groups (see open_capture()) of the match
+  /// during the same pass over the input
+  ///
+  capture_result find_captures(std::span<input_t> input) const {
+    capture_positions positions;
+    capture_result result{find_impl<true>(input, &positions), {}};
 
-    if constexpr (IS_UTF8) {
-      auto error = uv.final();
-      if (error != utf_validator::None) {
-        err(utf_validator::err_to_msg(error));
-      }
+    auto const& range = result.match.range;
+    if (range.empty()) {
+      return result;
     }
 
-    if (most_specific_matched_node) {
-      auto& node = m_nodes[most_specific_matched_node - 1];
-      auto& val  = node.value.value();
-      match_end -= val.back_by;
-      auto range = std::span<input_t>(input.begin() + match_begin, input.begin() + match_end);
-      if constexpr (!IS_REGEX) {
-        return find_result(range, &val.value);
-      } else {
-        return find_result(range);
+    auto const match_begin = size_t(range.data() - input.data());
+    auto const match_end   = match_begin + range.size();
+    for (size_t g = 0; g < MAX_CAPTURE_GROUPS; g++) {
+      if (!(positions.complete & (1 << g))) {
+        continue;
       }
-    } else {
-      if constexpr (ON_MATCH_ERROR == MatchErrorMode::Return) {
-        return find_result(nullptr);
-      } else if constexpr (ON_MATCH_ERROR == MatchErrorMode::Panic) {
-        return find_result();
-      } else {
-        []<bool flag = false>() {
-          static_assert(flag, "Variant not handled");
-        }
-        ();
+      // the close may lie within the input left over by back_by
+      auto const begin = std::max(positions.begin[g], match_begin);
+      auto const end   = std::min(positions.end[g], match_end);
+      if (begin <= end) {
+        result.groups[g] = input.subspan(begin, end - begin);
       }
     }
-#undef err
-  };
+    return result;
+  }
 
   ///
-  /// Apply the find function many times over the data to gather all find results
-  /// and returns an iterator which generates each result
+  /// Every match of the input, found by running find() over it repeatedly, each search resuming where the previous
+  /// match ended, as a lazy range of find_result
   ///
-  /// NOTE: It is generally recommended to implement this yourself, as this function is only designed
-  /// for the most generic use-case
+  /// matches are found one at a time as the range is iterated, without allocating, so the iteration may stop early,
+  /// e.g through std::views::take, or be resumed from a copy of an iterator. The range must outlive its iterators
   ///
-  auto find_many(std::span<Transition_T> input) const {
-    struct ResultGeneratorIterator {
-      using iterator_concept [[maybe_unused]] = std::contiguous_iterator_tag;
-      using difference_type                   = find_result;
-      using element_type                      = find_result;
-      using pointer                           = find_result*;
-      using reference                         = find_result&;
-
-    private:
-      StateMachine const* machine;
-      std::span<input_t> data;
-      find_result next;
+  /// matches of zero length (a trailing context covering the whole match) are skipped, the search moving on by one
+  /// element instead
+  ///
+  /// like find(), the input read is validated as utf8: malformed input yields a single error result, after the
+  /// matches preceding it, which ends the range
+  ///
+  auto find_many(std::span<input_t> input) const {
+    return match_view(this, input);
+  }
 
-      void load_next() {
-        next = machine->find(data);
-        if (next.range.size() == 0) {
-          data = {};
-        } else {
-          data = {next.range.end(), data.end()};
-        }
-      }
+  ///
+  /// The number of matches yielded by find_many(), without building any result
+  ///
+  size_t count_matches(std::span<input_t> input) const {
+    size_t count = 0;
+    count_from(input, 0, input.size(), [&](size_t, int delta) { count += delta; });
+    return count;
+  }
 
-    public:
-      ResultGeneratorIterator(StateMachine const* m, std::span<input_t> data) : machine(m), data(data) {
-        load_next();
-      };
+  ///
+  /// Identical to count_matches(input), with the input split into 'chunks' counted independently of one another
+  ///
+  /// 'for_each(chunks, count_chunk)' must call count_chunk(i) once for every i < chunks, possibly concurrently, e.g
+  /// through std::for_each(std::execution::par, ...). The chunks are then stitched together, rescanning the elements
+  /// around a boundary only when a match straddles it
+  ///
+  template <typename ForEach_F>
+  size_t count_matches(std::span<input_t> input, size_t chunks, ForEach_F&& for_each) const {
+    std::vector<size_t> counts(std::max<size_t>(chunks, 1));
+    count_chunked(input, counts.size(), for_each, [&](size_t chunk, size_t, int delta) { counts[chunk] += delta; });
+    return std::accumulate(counts.begin(), counts.end(), size_t(0));
+  }
 
-      void operator++() {
-        load_next();
-      }
+  ///
+  /// Counts the matches of count_matches() by their value, adding them to 'out_counts[value]'
+  ///
+  /// every value held by the machine must be an index within 'out_counts', see count_matches() for what is counted
+  ///
+  void count_by_value(std::span<input_t> input, std::span<size_t> out_counts) const
+    requires(std::is_integral_v<Value_T> || std::is_enum_v<Value_T>)
+  {
+    check_count_range(out_counts.size());
+    count_from(input, 0, input.size(), [&](size_t state, int delta) {
+      out_counts[size_t(m_nodes[state - 1].value->value)] += delta;
+    });
+  }
 
-      find_result const& operator*() const {
-        return next;
-      }
+  ///
+  /// Identical to count_by_value(input, out_counts), with the input split into chunks as by count_matches()
+  ///
+  template <typename ForEach_F>
+  void count_by_value(std::span<input_t> input, std::span<size_t> out_counts, size_t chunks, ForEach_F&& for_each) const
+    requires(std::is_integral_v<Value_T> || std::is_enum_v<Value_T>)
+  {
+    check_count_range(out_counts.size());
+    chunks = std::max<size_t>(chunks, 1);
+
+    // every chunk tallies apart, so that concurrent chunks never share a counter
+    auto const width = out_counts.size();
+    std::vector<size_t> counts(chunks * width);
+    count_chunked(input, chunks, for_each, [&](size_t chunk, size_t state, int delta) {
+      counts[chunk * width + size_t(m_nodes[state - 1].value->value)] += delta;
+    });
+    for (size_t i = 0; i < counts.size(); i++) {
+      out_counts[i % width] += counts[i];
+    }
+  }
 
-      bool operator!=(ResultGeneratorIterator const& other) const {
-        return other.data.size() != data.size();
+  ///
+  /// Rewrites the input with every match of find_many() replaced, in a single pass
+  ///
+  /// the rewritten input is handed to 'sink' piece by piece, as std::span<input_t const>: the elements between matches
+  /// are handed over in place, and every match is replaced by 'replacement(match)', given the match's find_result and
+  /// returning any contiguous range, such as a std::string_view. Nothing is allocated, 'sink' may append to a buffer
+  /// reserved beforehand
+  ///
+  /// see StreamMatcher for replacing over an input delivered in chunks
+  ///
+  template <typename Replace_F, typename Sink_F>
+  void replace_all(std::span<input_t> input, Replace_F&& replacement, Sink_F&& sink) const
+    requires std::invocable<Replace_F&, find_result const&>
+  {
+    size_t gap = 0; // start of the elements not handed over yet
+    size_t pos = 0;
+    while (pos < input.size()) {
+      auto const [accept, next] = attempt_at(input, pos);
+      if (accept == 0) {
+        pos = next;
+        continue;
       }
-    };
-
-    struct ResultGenerator {
-    private:
-      ResultGeneratorIterator _begin;
-      ResultGeneratorIterator _end;
-
-    public:
-      ResultGenerator(StateMachine const* sm, std::span<input_t> sp) : _begin({sm, sp}), _end({nullptr, {}}) {
+      if (gap != pos) {
+        sink(std::span<input_t const>(input.data() + gap, pos - gap));
       }
 
-      auto begin() const {
-        return _begin;
+      auto const range = input.subspan(pos, next - pos);
+      if constexpr (HAS_VALUE) {
+        sink(std::span<input_t const>(replacement(find_result(range, &m_nodes[accept - 1].value->value))));
+      } else {
+        sink(std::span<input_t const>(replacement(find_result(range))));
       }
+      gap = pos = next;
+    }
+    if (gap != input.size()) {
+      sink(std::span<input_t const>(input.data() + gap, input.size() - gap));
+    }
+  }
 
-      auto end() const {
-        return _end;
-      }
-    };
+  ///
+  /// Identical to replace_all(input, replacement, sink), every match being replaced by the same elements
+  ///
+  template <typename Sink_F, typename Char_T = input_t>
+  void replace_all(std::span<input_t> input,
+                   std::type_identity_t<std::basic_string_view<Char_T>> replacement,
+                   Sink_F&& sink) const {
+    replace_all(input, [&](find_result const&) { return replacement; }, sink);
+  }
 
-    return ResultGenerator(this, input);
-  };
+  ///
+  /// The fields of the input delimited by the matches of this machine, as a lazy range of std::span<input_t>
+  ///
+  /// the delimiters are the matches of find_many(), found one field at a time as the range is iterated, without
+  /// allocating. A delimiter's trailing context (see exit_point()'s 'back_by') is left at the start of the field after
+  /// it. Every delimiter separates two fields, which may be empty, so an input without delimiters, including an
+  /// empty input, is a single field
+  ///
+  /// the range must outlive its iterators
+  ///
+  auto split(std::span<input_t> input) const {
+    return split_view(this, input);
+  }
 
   ///
   /// Test the input to check if the entire input matches the state machine
@@ -778,7 +1467,7 @@ public:
   ///
   /// Note: the back_by setting has no effect in this function
   ///
-  template <bool const INCLUDE_EOF = false> match_result matches(std::span<input_t> input) {
+  template <bool const INCLUDE_EOF = false> match_result matches(std::span<input_t> input) const {
 #define err(msg)                                                                                                       \
   if constexpr (ON_MATCH_ERROR == MatchErrorMode::Panic) mutils::PANIC(msg);                                           \
   else return {msg};
@@ -786,14 +1475,22 @@ public:
       if constexpr (IS_REGEX) {
         return false;
       } else {
-        return nullptr;
+        return (Value_T const*)nullptr;
       }
     }();
     size_t current    = 1;
     utf_validator uv;
+    [[maybe_unused]] ScopedMatchStats<Stats_T> stats(m_stats);
     for (auto transition : input) {
       auto next = m_nodes[current - 1].rt_get_transition(transition);
 
+      if constexpr (Stats_T::ENABLED) {
+        stats.local.bytes_scanned++;
+        if (next) {
+          count_transition(stats.local, m_nodes[current - 1], transition, next);
+        }
+      }
+
       if constexpr (IS_UTF8) {
         auto error = uv.next(transition);
         if (error != utf_validator::None) {
@@ -818,6 +1515,10 @@ public:
       auto eof = m_nodes[current - 1].get_eof();
       if (eof) {
         current = eof;
+        if constexpr (Stats_T::ENABLED) {
+          stats.local.transitions++;
+          m_stats.visit(current);
+        }
       } else {
         return null_val;
       }
@@ -828,7 +1529,7 @@ public:
       if constexpr (IS_REGEX) {
         return true;
       } else {
-        return &m_nodes[current - 1].value.value();
+        return &m_nodes[current - 1].value.value().value;
       }
     } else {
       return null_val;
@@ -836,15 +1537,167 @@ public:
 #undef err
   }
 
+  ///
+  /// The greatest edit distance accepted by fuzzy_lookup()
+  ///
+  static constexpr size_t MAX_FUZZY_EDITS = 2;
 
-protected:
   ///
-  /// Traverses the entire node chain and converts any transitions to null nodes into
+  /// An exit point located by fuzzy_lookup(), along with its edit distance from the input
+  ///
+  template <typename Val_T> struct fuzzy_match_t {
+    Val_T const* value;
+    size_t distance;
+  };
+
+  template <> struct fuzzy_match_t<void> {
+    size_t distance;
+  };
+
+  using fuzzy_match = fuzzy_match_t<Value_T>;
+
+  ///
+  /// Locate every entry of the machine within 'max_edits' insertions, deletions or substitutions of the entire input
+  ///
+  /// the machine is walked once alongside the Levenshtein automaton of the input: every walked path carries the edit
+  /// distances between itself and each prefix of the input, and is abandoned as soon as none of them is within
+  /// 'max_edits'. Edits are counted in characters, a utf8 sequence being a single character, and the default
+  /// transition stands for any one character
+  ///
+  /// each exit point is reported once with its smallest distance, ordered by distance and then by state
+  /// regex machines report at most one match, the closest one
+  ///
+  /// NOTE: like matches(), eof transitions are not considered
+  ///
+  std::vector<fuzzy_match> fuzzy_lookup(std::span<input_t> input, size_t max_edits) const {
+    MUTILS_ASSERT_LTE(max_edits, MAX_FUZZY_EDITS, "fuzzy_lookup supports at most 2 edits");
+
+    std::vector<fuzzy_char> chars;
+    for (size_t i = 0; i < input.size();) {
+      size_t length = 1;
+      if constexpr (IS_UTF8) {
+        auto const header = (unsigned char)input[i];
+        if ((header & 0b11000000) == 0b11000000) {
+          length = std::min<size_t>(std::min(std::countl_one(header), 4), input.size() - i);
+        }
+        fuzzy_char packed = 0;
+        for (size_t j = 0; j < length; j++) {
+          auto const byte = (unsigned char)input[i + j];
+          packed          = (packed << 8) | (byte & 0b10000000 ? byte & 0b10111111 : byte);
+        }
+        chars.push_back(packed);
+      } else {
+        chars.push_back(input[i]);
+      }
+      i += length;
+    }
+
+    fuzzy_walk walk{std::move(chars), {}, {}, max_edits};
+    auto const width = walk.chars.size() + 1;
+    walk.rows.resize(width);
+    for (size_t i = 0; i < width; i++) {
+      walk.rows[i] = std::uint8_t(std::min(i, max_edits + 1));
+    }
+    fuzzy_walk_from(walk, ROOT_STATE, 0);
+
+    std::vector<fuzzy_match> result;
+    for (auto [state, distance] : walk.closest) {
+      if constexpr (IS_REGEX) {
+        if (result.empty() || distance < result[0].distance) {
+          result = {fuzzy_match{distance}};
+        }
+      } else {
+        result.push_back(fuzzy_match{exit_value(state), distance});
+      }
+    }
+    std::stable_sort(result.begin(), result.end(), [](auto const& a, auto const& b) { return a.distance < b.distance; });
+    return result;
+  }
+
+  ///
+  /// A snapshot of the counters collected by the match functions
+  ///
+  /// only available when the machine is instrumented, i.e Stats_T = MatchStats
+  ///
+  MatchStatsSnapshot stats() const
+    requires Stats_T::ENABLED
+  {
+    return m_stats.snapshot();
+  }
+
+  ///
+  /// Zero every match counter, and resize the per-state counters to the current node count
+  ///
+  /// NOTE: This must not run concurrently with any match function
+  ///
+  Self_T& reset_stats() {
+    m_stats.resize(m_nodes.size());
+    return *(Self_T*)this;
+  }
+
+  ////////////////////////////////////////////////////
+  /// LOW LEVEL TRAVERSAL, for engines built on top of the machine
+  ////////////////////////////////////////////////////
+
+  static constexpr size_t ROOT_STATE = 1;
+
+  ///
+  /// The state reached from 'state' by the input element, or 0 if there is none
+  ///
+  __attribute__((always_inline)) size_t step(size_t state, input_t transition) const {
+    return m_nodes[state - 1].rt_get_transition(transition);
+  }
+
+  ///
+  /// The state reached from 'state' by the end of the input, or 0 if there is none
+  ///
+  size_t step_eof(size_t state) const {
+    return m_nodes[state - 1].get_eof();
+  }
+
+  ///
+  /// The back_by of the state's exit point, or std::nullopt when the state is not an exit point
+  ///
+  std::optional<size_t> exit_back_by(size_t state) const {
+    auto const& value = m_nodes[state - 1].value;
+    if (value.has_value()) {
+      return value->back_by;
+    }
+    return std::nullopt;
+  }
+
+  ///
+  /// The value held by the state's exit point, or nullptr when the state is not an exit point
+  ///
+  Value_T const* exit_value(size_t state) const
+    requires HAS_VALUE
+  {
+    auto const& value = m_nodes[state - 1].value;
+    return value.has_value() ? &value->value : nullptr;
+  }
+
+private:
+  __attribute__((always_inline)) void
+  count_transition(typename Stats_T::Local& local, Node_T const& from, input_t transition, size_t to) const {
+    local.transitions++;
+    if (!from.rt_has_explicit_transition(transition)) {
+      local.default_transitions++;
+    }
+    if (m_nodes[to - 1].value.has_value()) {
+      local.accepts++;
+    }
+    m_stats.visit(to);
+  }
+
+protected:
+  ///
+  /// Traverses the entire node chain and converts any transitions to null nodes into
   /// null transitions, this nullification bubbles up
   /// all the way to the root
   ///
-  void nullify_nullrefs() {
+  size_t nullify_nullrefs() {
     std::vector<bool> nulls(m_nodes.size(), false);
+    note_scratch(nulls);
 
     size_t i = 0;
     for (Node_T& n : m_nodes) {
@@ -855,8 +1708,10 @@ protected:
     }
 
 
+    size_t iterations = 0;
     while (true) {
       bool has_nulled = false;
+      iterations++;
 
       for (Node_T& n : m_nodes) {
         if (nulls[node_index(n) - 1]) {
@@ -874,197 +1729,1179 @@ protected:
         }
       }
 
-      if (!has_nulled) {
+      if (!has_nulled) {
+        break;
+      }
+    }
+    return iterations;
+  }
+
+  size_t remove_duplicates() {
+    // This action has to be applied multiple times as nodes have the tendency
+    // to form chains which are easily simplifiable
+    size_t iterations = 1;
+    while (remove_duplicates_once()) {
+      iterations++;
+    }
+    return iterations;
+  }
+
+  ///
+  /// Splits the blocks of nodes (block[idx], for every node idx) until the transitions of the nodes of a block
+  /// lead into the same blocks, returns the new block count and renumbers 'block' accordingly
+  ///
+  /// nodes sharing a block must have transitions on the same keys. Blocks are split by Hopcroft's algorithm, each
+  /// split only revisits the predecessors of the smaller half, so this runs in O(m log n) for m transitions
+  ///
+  size_t refine_partition(std::vector<size_t>& block, size_t blocks) {
+    size_t const count = m_nodes.size();
+
+    // the predecessors of every node, grouped by target, as (key, predecessor) pairs, with keys renumbered densely
+    std::map<std::uint64_t, size_t> key_ids;
+    std::vector<size_t> in_begin(count + 2, 0);
+    for (size_t idx = 1; idx <= count; idx++) {
+      get_node(idx).each_transition([&](auto k, auto& t) {
+        key_ids.try_emplace(k.ordinal(), key_ids.size());
+        in_begin[t + 1]++;
+      });
+    }
+    std::partial_sum(in_begin.begin(), in_begin.end(), in_begin.begin());
+    std::vector<std::pair<size_t, size_t>> incoming(in_begin.back());
+    note_scratch(incoming);
+    {
+      auto fill = in_begin;
+      for (size_t idx = 1; idx <= count; idx++) {
+        get_node(idx).each_transition([&](auto k, auto& t) {
+          incoming[fill[t]++] = {key_ids[k.ordinal()], idx};
+        });
+      }
+    }
+
+    // every block is a range of 'members', the nodes marked while splitting are moved to the front of their block
+    struct Range {
+      size_t begin;
+      size_t end;
+      size_t marked;
+      bool queued;
+    };
+    std::vector<Range> ranges(blocks, Range{0, 0, 0, true});
+    std::vector<size_t> members(count);
+    std::vector<size_t> position(count + 1);
+    {
+      std::vector<size_t> sizes(blocks, 0);
+      for (size_t idx = 1; idx <= count; idx++) {
+        sizes[block[idx]]++;
+      }
+      size_t at = 0;
+      for (size_t b = 0; b < blocks; b++) {
+        ranges[b] = Range{at, at, 0, true};
+        at += sizes[b];
+      }
+      for (size_t idx = 1; idx <= count; idx++) {
+        auto& r          = ranges[block[idx]];
+        position[idx]    = r.end;
+        members[r.end++] = idx;
+      }
+    }
+    note_scratch(members);
+    note_scratch(position);
+
+    std::vector<size_t> worklist(blocks);
+    std::iota(worklist.begin(), worklist.end(), 0);
+    std::vector<std::vector<size_t>> by_key(key_ids.size());
+    std::vector<size_t> keys;
+    std::vector<size_t> touched;
+    while (!worklist.empty()) {
+      auto const splitter = worklist.back();
+      worklist.pop_back();
+      ranges[splitter].queued = false;
+
+      // the predecessors are gathered before any split, which may split the splitter itself
+      for (size_t i = ranges[splitter].begin; i < ranges[splitter].end; i++) {
+        auto const target = members[i];
+        for (size_t e = in_begin[target]; e < in_begin[target + 1]; e++) {
+          auto const [key, from] = incoming[e];
+          if (by_key[key].empty()) {
+            keys.push_back(key);
+          }
+          by_key[key].push_back(from);
+        }
+      }
+
+      for (auto key : keys) {
+        for (auto from : by_key[key]) {
+          auto& r = ranges[block[from]];
+          if (position[from] < r.begin + r.marked) {
+            continue;
+          }
+          // swap the node to the end of the marked front of its block
+          auto const swapped = members[r.begin + r.marked];
+          std::swap(members[position[from]], members[r.begin + r.marked]);
+          position[swapped] = position[from];
+          position[from]    = r.begin + r.marked;
+          if (r.marked++ == 0) {
+            touched.push_back(block[from]);
+          }
+        }
+        by_key[key].clear();
+
+        for (auto b : touched) {
+          auto& r           = ranges[b];
+          auto const marked = r.marked;
+          r.marked          = 0;
+          if (marked == r.end - r.begin) {
+            continue;
+          }
+          // the marked nodes form a new block
+          auto const split = ranges.size();
+          ranges.push_back(Range{r.begin, r.begin + marked, 0, false});
+          ranges[b].begin += marked;
+          for (size_t i = ranges[split].begin; i < ranges[split].end; i++) {
+            block[members[i]] = split;
+          }
+          if (ranges[b].queued) {
+            ranges[split].queued = true;
+            worklist.push_back(split);
+          } else {
+            auto const smaller     = marked <= ranges[b].end - ranges[b].begin ? split : b;
+            ranges[smaller].queued = true;
+            worklist.push_back(smaller);
+          }
+        }
+        touched.clear();
+      }
+      keys.clear();
+    }
+    return ranges.size();
+  }
+
+  bool remove_duplicates_once() {
+    bool has_removed_dup = false;
+
+    std::vector<bool> cursors(m_nodes.size(), false);
+    note_scratch(cursors);
+
+    for (auto c : construction_state.cursors) {
+      cursors[c - 1] = true;
+    }
+    // Hopcroft's partition refinement, nodes start out split by everything but where their transitions lead,
+    // then blocks are split by the blocks their transitions lead into until no block splits any further,
+    // so that equal loops are merged too, not only nodes whose transitions are already identical
+    size_t const count = m_nodes.size();
+    std::vector<size_t> block(count + 1, 0);
+    note_scratch(block);
+
+    // the root keeps a block of its own, as do pure nulls (nulls without cursors on them)
+    size_t blocks = 1;
+    std::map<std::vector<std::uint64_t>, std::vector<size_t>> alike;
+    for (size_t idx = 2; idx <= count; idx++) {
+      Node_T& node = get_node(idx);
+      if (node.is_null() && !cursors[idx - 1]) {
+        block[idx] = blocks++;
+        continue;
+      }
+
+      std::vector<std::uint64_t> signature = {cursors[idx - 1], node.capture_open, node.capture_close};
+      node.each_transition([&](auto k, auto&) {
+        signature.push_back(k.ordinal());
+      });
+      alike[std::move(signature)].push_back(idx);
+    }
+    for (auto& [signature, members] : alike) {
+      // values have no ordering, so the few distinct values among alike nodes are told apart by comparison
+      std::vector<size_t> firsts;
+      for (auto idx : members) {
+        auto const same = std::find_if(firsts.begin(), firsts.end(), [&](size_t first) {
+          return get_node(first).value == get_node(idx).value;
+        });
+        if (same == firsts.end()) {
+          firsts.push_back(idx);
+          block[idx] = blocks++;
+        } else {
+          block[idx] = block[*same];
+        }
+      }
+    }
+    blocks = refine_partition(block, blocks);
+    // every duplicate is merged into the last created of its equals
+    std::vector<size_t> keep(blocks, 0);
+    for (size_t idx = 2; idx <= count; idx++) {
+      keep[block[idx]] = idx;
+    }
+    std::vector<size_t> replacements(count + 1);
+    std::iota(replacements.begin(), replacements.end(), 0);
+    note_scratch(replacements);
+    for (size_t idx = 2; idx <= count; idx++) {
+      if (keep[block[idx]] != idx) {
+        replacements[idx] = keep[block[idx]];
+        has_removed_dup   = true;
+      }
+    }
+
+    if (has_removed_dup) {
+      for (Node_T& n : m_nodes) {
+        n.each_transition([&](auto, auto& v) {
+          v = replacements[v];
+        });
+      }
+      for (size_t idx = 2; idx < replacements.size(); idx++) {
+        if (replacements[idx] != idx) {
+          get_node(idx).nullify();
+          cursors[idx - 1] = false;
+        }
+      }
+    }
+
+    construction_state.cursors = {};
+    size_t i                   = 1;
+    for (bool c : cursors) {
+      if (c) {
+        construction_state.cursors.push_back(i);
+      }
+      i++;
+    }
+    return has_removed_dup;
+  }
+
+  ///
+  /// Traverses the tree and marks any unreachable nodes as null
+  ///
+  size_t nullify_orphans() {
+    std::vector<bool> reachables(m_nodes.size(), false);
+    note_scratch(reachables);
+    reachables[0] = true; // root node is always reachable
+
+    size_t iterations = 0;
+    while (true) {
+      bool has_expanded = false;
+      iterations++;
+      for (Node_T& n : m_nodes) {
+        if (reachables[node_index(n) - 1]) {
+          n.each_transition([&](auto k, auto& t) {
+            const size_t corrected_transition = t - 1;
+            if (reachables[corrected_transition]) {
+              return;
+            }
+            reachables[corrected_transition] = true;
+            has_expanded                     = true;
+          });
+        }
+      }
+      if (!has_expanded) {
+        break;
+      }
+    }
+
+    for (auto& c : construction_state.cursors) {
+      if (!reachables[c]) {
+        c = 0;
+      }
+    }
+    for (auto i = 0; i < m_nodes.size(); i++) {
+      if (!reachables[i]) {
+        m_nodes[i].nullify();
+      }
+    }
+
+    std::vector<size_t> new_cursors;
+    std::copy_if(construction_state.cursors.begin(),
+                 construction_state.cursors.end(),
+                 std::back_inserter(new_cursors),
+                 [&](auto c) {
+                   return c != 0;
+                 });
+    note_scratch(new_cursors);
+    construction_state.cursors = new_cursors;
+    return iterations;
+  }
+
+  void remove_blanks()
+    requires IS_DYNAMIC
+  {
+    // remove any nodes containing no data, and clear all references to them
+    StateMachineNodeStore<Node_T, 0> new_nodes;
+    std::vector<size_t> mappings(m_nodes.size(), 0);
+    mappings[0] = 1;
+    size_t idx  = 1;
+    for (auto& node : m_nodes) {
+
+      // If the node is null. we do not keep it, the exception is the root node and any nodes with cursors
+      if (node.is_null() && node_index(node) != 1 && !has_cursor(idx)) {
+        continue;
+      }
+      new_nodes.push(node);
+
+      mappings[node_index(node) - 1] = idx;
+      idx++;
+    }
+
+    for (Node_T& n : new_nodes) {
+
+      // remap transitions to reflect the new cursors
+      n.each_transition([&](auto key, auto& t) {
+        if (t != 0) {
+          t = mappings[t - 1];
+        }
+      });
+    }
+
+    std::vector<size_t> new_cursors;
+    for (auto c : construction_state.cursors) {
+      auto mapped = mappings[c - 1];
+      new_cursors.push_back(mapped);
+    }
+    note_scratch(new_nodes.store);
+    note_scratch(mappings);
+    note_scratch(new_cursors);
+    construction_state.cursors = new_cursors;
+    m_nodes                    = new_nodes;
+  }
+
+  ///
+  /// Runs a single optimize() pass, tracing it when a sink is set
+  /// 'pass' returns the number of iterations it took
+  ///
+  template <typename Pass> void run_pass(char const* name, Pass&& pass)
+    requires IS_DYNAMIC
+  {
+    if (!construction_state.trace_sink) {
+      pass();
+      return;
+    }
+
+    OptimizePassTrace trace;
+    trace.pass                       = name;
+    trace.nodes_before               = live_node_count();
+    construction_state.scratch_bytes = 0;
+
+    auto const start = std::chrono::steady_clock::now();
+    trace.iterations = pass();
+    trace.wall_time  = std::chrono::steady_clock::now() - start;
+
+    trace.nodes_after     = live_node_count();
+    trace.bytes_allocated = construction_state.scratch_bytes;
+    construction_state.trace_sink(trace);
+  }
+
+  ///
+  /// A character as compared by fuzzy_lookup(), utf8 sequences being packed as in the transition keys
+  ///
+  using fuzzy_char = std::conditional_t<IS_UTF8, std::uint32_t, input_t>;
+
+  ///
+  /// Calls 'callback(character, target)' for every character leaving the state, the default transition being given
+  /// as an empty character
+  ///
+  template <typename F> void each_fuzzy_edge(size_t state, F&& callback) const {
+    auto const& node = m_nodes[state - 1];
+    node.each_value_transition([&](auto key, size_t to) {
+      if constexpr (IS_UTF8) {
+        if (key & 0b10000000) {
+          // the key of a header byte lacks its second bit, which announces the continuation bytes
+          auto const continuations = std::min(std::countl_one((unsigned char)(key | 0b01000000)), 4) - 1;
+          each_utf8_continuation(fuzzy_char(key), to, continuations, callback);
+          return;
+        }
+      }
+      callback(std::optional<fuzzy_char>(fuzzy_char(key)), to);
+    });
+    if (node.get_def() != 0) {
+      callback(std::optional<fuzzy_char>(), node.get_def());
+    }
+  }
+
+  ///
+  /// The state of a fuzzy_lookup() walk, the rows hold the edit distances between the walked path and every prefix of
+  /// the input, one row per depth of the path
+  ///
+  struct fuzzy_walk {
+    std::vector<fuzzy_char> chars;
+    std::vector<std::uint8_t> rows;
+    std::map<size_t, size_t> closest; // exit state -> smallest distance
+    size_t max_edits;
+  };
+
+  ///
+  /// Walks every path leaving the state which may still come within max_edits of the input
+  ///
+  /// no state is marked as visited: every step moves the band of reachable distances one prefix further, so a path
+  /// can not outgrow the input by more than max_edits characters, loops included
+  ///
+  void fuzzy_walk_from(fuzzy_walk& walk, size_t state, size_t depth) const {
+    auto const width = walk.chars.size() + 1;
+    auto const k     = walk.max_edits;
+    // distances beyond max_edits are all alike
+    auto const over = std::uint8_t(k + 1);
+    // only the distances within max_edits of the diagonal may be within max_edits, the others are never written
+    auto const cell = [&](size_t d, size_t i) -> std::uint8_t {
+      return i + k >= d && i <= d + k ? walk.rows[d * width + i] : over;
+    };
+
+    auto const distance = cell(depth, width - 1);
+    if (m_nodes[state - 1].value.has_value() && distance < over) {
+      auto [found, inserted] = walk.closest.try_emplace(state, distance);
+      found->second          = std::min<size_t>(found->second, distance);
+    }
+
+    auto const next  = depth + 1;
+    auto const first = next > k ? next - k : 0;
+    auto const last  = std::min(width - 1, next + k);
+    if (first > last) {
+      return;
+    }
+    if (walk.rows.size() < (next + 1) * width) {
+      walk.rows.resize((next + 1) * width);
+    }
+
+    each_fuzzy_edge(state, [&](std::optional<fuzzy_char> c, size_t to) {
+      // deeper walks may grow the rows, so the row is located anew for every edge
+      auto* const out      = &walk.rows[next * width];
+      std::uint8_t left    = over;
+      std::uint8_t nearest = over;
+      for (size_t i = first; i <= last; i++) {
+        if (i == 0) {
+          left = std::uint8_t(std::min<size_t>(next, over));
+        } else {
+          auto const substitution = cell(depth, i - 1) + (c.has_value() && *c != walk.chars[i - 1]);
+          left = std::uint8_t(std::min<int>({substitution, cell(depth, i) + 1, left + 1, over}));
+        }
+        out[i]  = left;
+        nearest = std::min(nearest, left);
+      }
+      if (nearest < over) {
+        fuzzy_walk_from(walk, to, next);
+      }
+    });
+  }
+
+  template <typename F> void each_utf8_continuation(fuzzy_char prefix, size_t state, int remaining, F& callback) const {
+    if (remaining == 0) {
+      callback(std::optional<fuzzy_char>(prefix), state);
+      return;
+    }
+    m_nodes[state - 1].each_value_transition([&](auto key, size_t to) {
+      each_utf8_continuation((prefix << 8) | fuzzy_char(key), to, remaining - 1, callback);
+    });
+  }
+
+  ///
+  /// Offsets recorded for each capture group while matching
+  ///
+  struct capture_positions {
+    std::array<size_t, MAX_CAPTURE_GROUPS> begin{};
+    std::array<size_t, MAX_CAPTURE_GROUPS> end{};
+    std::array<size_t, MAX_CAPTURE_GROUPS> opened{}; // where the open group of each pending bit began
+    std::uint16_t complete = 0;                       // groups which were both opened and closed
+    std::uint16_t pending  = 0;                       // groups opened since they were last closed
+
+    // apply the tags of a state entered once 'offset' elements of the input were consumed
+    //
+    // a state which both closes and opens an open group ends one repetition of it and begins the next,
+    // so the group keeps the repetition just ended, rather than the empty span of the next one
+    __attribute__((always_inline)) void enter(Node_T const& node, size_t offset) {
+      std::uint16_t const reopen = node.capture_open & node.capture_close & pending;
+      open(node.capture_open & ~reopen, offset);
+      for (std::uint16_t close = node.capture_close; close != 0; close &= close - 1) {
+        auto const g = std::countr_zero(close);
+        if (pending & (1 << g)) {
+          begin[g] = opened[g];
+        }
+        end[g] = offset;
+        complete |= (1 << g);
+        pending &= ~(1 << g);
+      }
+      open(reopen, offset);
+    }
+
+    __attribute__((always_inline)) void open(std::uint16_t groups, size_t offset) {
+      for (; groups != 0; groups &= groups - 1) {
+        auto const g = std::countr_zero(groups);
+        opened[g]    = offset;
+        pending |= (1 << g);
+      }
+    }
+  };
+
+  ///
+  /// The bytes which may begin a match, letting a search skip over the others
+  ///
+  struct lead_bytes {
+    bool filtered = false; // false when any byte may begin a match
+    int sole      = -1;    // the only byte which may begin a match, if there is one
+    std::array<bool, 256> may_lead{};
+  };
+
+  lead_bytes leading_bytes() const {
+    lead_bytes leads;
+    if constexpr (std::is_same_v<input_t, char>) {
+      auto const& root = m_nodes[ROOT_STATE - 1];
+      if (root.get_def() != 0) {
+        return leads;
+      }
+      size_t count = 0;
+      for (int b = 0; b < 256; b++) {
+        // matches of utf8 machines never begin in the middle of a codepoint
+        bool const continuation = IS_UTF8 && (b & 0b11000000) == 0b10000000;
+        leads.may_lead[b]       = !continuation && root.rt_get_transition(char(b)) != 0;
+        if (leads.may_lead[b]) {
+          count++;
+          leads.sole = b;
+        }
+      }
+      leads.filtered = true;
+      if (count != 1) {
+        leads.sole = -1;
+      }
+    }
+    return leads;
+  }
+
+  struct located_match {
+    size_t begin;
+    size_t end;
+    size_t state; // the exit state of the match
+  };
+
+  ///
+  /// The first match at or after 'pos', skipping over the bytes which cannot begin one
+  ///
+  /// the work done is counted into 'local' when it is given
+  ///
+  std::optional<located_match> next_match(lead_bytes const& leads,
+                                          std::span<input_t> input,
+                                          size_t pos,
+                                          [[maybe_unused]] typename Stats_T::Local* local = nullptr) const {
+    while (pos < input.size()) {
+      [[maybe_unused]] auto const skipped_from = pos;
+      if constexpr (std::is_same_v<input_t, char>) {
+        if (leads.sole >= 0) {
+          auto const found = (char const*)std::memchr(input.data() + pos, leads.sole, input.size() - pos);
+          pos              = found ? size_t(found - input.data()) : input.size();
+        } else if (leads.filtered) {
+          while (pos < input.size() && !leads.may_lead[(unsigned char)input[pos]]) {
+            pos++;
+          }
+        }
+      }
+      if constexpr (Stats_T::ENABLED) {
+        if (local) {
+          local->bytes_scanned += pos - skipped_from;
+        }
+      }
+      if (pos == input.size()) {
+        return std::nullopt;
+      }
+
+      auto const [accept, next] = attempt_at(input, pos, local);
+      if (accept != 0) {
+        return located_match{pos, next, accept};
+      }
+      if constexpr (Stats_T::ENABLED) {
+        if (local) {
+          local->restarts++;
+        }
+      }
+      pos = next;
+    }
+    return std::nullopt;
+  }
+
+  class split_view : public std::ranges::view_interface<split_view> {
+    StateMachine const* m_machine = nullptr;
+    std::span<input_t> m_input;
+    lead_bytes m_leads;
+
+  public:
+    class iterator {
+      static constexpr size_t LAST = std::numeric_limits<size_t>::max();
+
+      split_view const* m_view = nullptr;
+      size_t m_begin           = 0;    // start of the field
+      size_t m_end             = 0;    // end of the field, where the delimiter following it begins
+      size_t m_next            = LAST; // start of the next field, LAST when the field is the last one
+      bool m_done              = true;
+
+      void locate(size_t begin) {
+        m_begin          = begin;
+        auto const delim = m_view->m_machine->next_match(m_view->m_leads, m_view->m_input, begin);
+        m_end            = delim ? delim->begin : m_view->m_input.size();
+        m_next           = delim ? delim->end : LAST;
+      }
+
+    public:
+      using value_type       = std::span<input_t>;
+      using difference_type  = std::ptrdiff_t;
+      using iterator_concept = std::forward_iterator_tag;
+
+      iterator() = default;
+
+      explicit iterator(split_view const* view) : m_view(view), m_done(false) {
+        locate(0);
+      }
+
+      std::span<input_t> operator*() const {
+        return m_view->m_input.subspan(m_begin, m_end - m_begin);
+      }
+
+      iterator& operator++() {
+        if (m_next == LAST) {
+          m_done = true;
+        } else {
+          locate(m_next);
+        }
+        return *this;
+      }
+
+      iterator operator++(int) {
+        auto const copy = *this;
+        ++*this;
+        return copy;
+      }
+
+      bool operator==(iterator const& other) const {
+        return m_done == other.m_done && (m_done || m_begin == other.m_begin);
+      }
+
+      bool operator==(std::default_sentinel_t) const {
+        return m_done;
+      }
+    };
+
+    split_view() = default;
+
+    split_view(StateMachine const* machine, std::span<input_t> input) :
+        m_machine(machine), m_input(input), m_leads(machine->leading_bytes()) {
+    }
+
+    iterator begin() const {
+      return iterator(this);
+    }
+
+    std::default_sentinel_t end() const {
+      return std::default_sentinel;
+    }
+  };
+
+  class match_view : public std::ranges::view_interface<match_view> {
+    StateMachine const* m_machine = nullptr;
+    std::span<input_t> m_input;
+    lead_bytes m_leads;
+
+  public:
+    class iterator {
+      match_view const* m_view = nullptr;
+      located_match m_match    = {0, 0, 0}; // the state is 0 once past the last match
+      char const* m_error      = nullptr;   // the utf8 error yielded in place of a match, which ends the range
+      utf_validator m_uv;
+      size_t m_validated = 0; // the input before this index has been fed through m_uv
+
+      void locate(size_t pos) {
+        auto const& machine = *m_view->m_machine;
+        auto const& input   = m_view->m_input;
+
+        [[maybe_unused]] ScopedMatchStats<Stats_T> stats(machine.m_stats);
+        auto const match = machine.next_match(m_view->m_leads, input, pos, &stats.local);
+        m_match          = match ? *match : located_match{0, 0, 0};
+
+        if constexpr (IS_UTF8) {
+          // like find(), everything up to the end of the match is validated, or the whole input past the last match
+          auto const until = match ? match->end : input.size();
+          for (; m_validated < until; m_validated++) {
+            auto const error = m_uv.next(input[m_validated]);
+            if (error != utf_validator::None) {
+              return fail(error);
+            }
+          }
+          auto const truncated = match ? utf_validator::None : m_uv.final();
+          if (truncated != utf_validator::None) {
+            return fail(truncated);
+          }
+        }
+      }
+
+      void fail(typename utf_validator::Error error) {
+        if constexpr (ON_MATCH_ERROR == MatchErrorMode::Panic) {
+          mutils::PANIC(utf_validator::err_to_msg(error));
+        } else {
+          m_error = utf_validator::err_to_msg(error);
+          m_match = located_match{0, 0, 0};
+        }
+      }
+
+    public:
+      using value_type       = find_result;
+      using difference_type  = std::ptrdiff_t;
+      using iterator_concept = std::forward_iterator_tag;
+
+      iterator() = default;
+
+      explicit iterator(match_view const* view) : m_view(view) {
+        locate(0);
+      }
+
+      find_result operator*() const {
+        if constexpr (ON_MATCH_ERROR == MatchErrorMode::Return) {
+          if (m_error) {
+            return find_result(m_error);
+          }
+        }
+        auto const range = m_view->m_input.subspan(m_match.begin, m_match.end - m_match.begin);
+        if constexpr (HAS_VALUE) {
+          return find_result(range, &m_view->m_machine->m_nodes[m_match.state - 1].value->value);
+        } else {
+          return find_result(range);
+        }
+      }
+
+      iterator& operator++() {
+        if (m_error) {
+          m_error = nullptr;
+        } else {
+          locate(m_match.end);
+        }
+        return *this;
+      }
+
+      iterator operator++(int) {
+        auto const copy = *this;
+        ++*this;
+        return copy;
+      }
+
+      bool operator==(iterator const& other) const {
+        return m_match.state == other.m_match.state && m_match.begin == other.m_match.begin &&
+               m_error == other.m_error;
+      }
+
+      bool operator==(std::default_sentinel_t) const {
+        return m_match.state == 0 && !m_error;
+      }
+    };
+
+    match_view() = default;
+
+    match_view(StateMachine const* machine, std::span<input_t> input) :
+        m_machine(machine), m_input(input), m_leads(machine->leading_bytes()) {
+    }
+
+    iterator begin() const {
+      return iterator(this);
+    }
+
+    std::default_sentinel_t end() const {
+      return std::default_sentinel;
+    }
+  };
+
+  ///
+  /// A single attempt of the search at 'pos', as find() makes them
+  ///
+  struct count_attempt {
+    size_t accept; // exit state of the match, 0 when the attempt failed
+    size_t next;   // the position of the next attempt
+  };
+
+  count_attempt
+  attempt_at(std::span<input_t> input, size_t pos, [[maybe_unused]] typename Stats_T::Local* local = nullptr) const {
+    size_t state     = ROOT_STATE;
+    size_t accept    = 0;
+    size_t match_end = pos;
+    for (size_t i = pos; i < input.size(); i++) {
+      auto const& from = m_nodes[state - 1];
+      state            = from.rt_get_transition(input[i]);
+      if constexpr (Stats_T::ENABLED) {
+        if (local) {
+          local->bytes_scanned++;
+          if (state != 0) {
+            count_transition(*local, from, input[i], state);
+          }
+        }
+      }
+      if (state == 0) {
+        break;
+      }
+      if (m_nodes[state - 1].value.has_value()) {
+        accept    = state;
+        match_end = i + 1;
+      }
+    }
+
+    if (accept != 0) {
+      match_end -= std::min(m_nodes[accept - 1].value->back_by, match_end - pos);
+      if (match_end != pos) {
+        return {accept, match_end};
+      }
+    }
+
+    size_t next = pos + 1;
+    if constexpr (IS_UTF8) {
+      // never restart in the middle of a codepoint
+      while (next < input.size() && (input[next] & 0b11000000) == 0b10000000) {
+        next++;
+      }
+    }
+    return {0, next};
+  }
+
+  ///
+  /// Runs the attempts of the search from 'pos' until one begins at or past 'end', calling on_match(state, 1) for every
+  /// match, and returns the position of that attempt
+  ///
+  template <typename OnMatch_F>
+  size_t count_from(std::span<input_t> input, size_t pos, size_t end, OnMatch_F&& on_match) const {
+    while (pos < end) {
+      auto const [accept, next] = attempt_at(input, pos);
+      if (accept != 0) {
+        on_match(accept, 1);
+      }
+      pos = next;
+    }
+    return pos;
+  }
+
+  ///
+  /// Counts the chunks of the input through 'for_each', tallying each match with tally(chunk, state, delta)
+  ///
+  /// every chunk is searched as if an attempt began at its start, while the search actually enters it where the
+  /// previous chunk left off. Both searches are replayed side by side from there until they attempt the same position,
+  /// past which they agree: the replay of the actual search is tallied in, and the replay of the chunk's own search
+  /// tallied out
+  ///
+  template <typename ForEach_F, typename Tally_F>
+  void count_chunked(std::span<input_t> input, size_t chunks, ForEach_F& for_each, Tally_F&& tally) const {
+    std::vector<size_t> bounds(chunks + 1, input.size());
+    for (size_t i = 0; i < chunks; i++) {
+      bounds[i] = input.size() / chunks * i;
+      if constexpr (IS_UTF8) {
+        while (bounds[i] < input.size() && (input[bounds[i]] & 0b11000000) == 0b10000000) {
+          bounds[i]++;
+        }
+      }
+    }
+
+    std::vector<size_t> resume(chunks);
+    for_each(chunks, [&](size_t chunk) {
+      resume[chunk] = count_from(input, bounds[chunk], bounds[chunk + 1], [&](size_t state, int delta) {
+        tally(chunk, state, delta);
+      });
+    });
+
+    for (size_t chunk = 1; chunk < chunks; chunk++) {
+      auto const end = bounds[chunk + 1];
+      size_t actual  = resume[chunk - 1];
+      size_t own     = bounds[chunk];
+      while (actual != own && (actual < end || own < end)) {
+        if (actual < own) {
+          auto const [accept, next] = attempt_at(input, actual);
+          if (accept != 0) {
+            tally(chunk, accept, 1);
+          }
+          actual = next;
+        } else {
+          auto const [accept, next] = attempt_at(input, own);
+          if (accept != 0) {
+            tally(chunk, accept, -1);
+          }
+          own = next;
+        }
+      }
+      if (actual != own) {
+        resume[chunk] = actual;
+      }
+    }
+  }
+
+  void check_count_range(size_t size) const {
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+      auto const& value = m_nodes[i].value;
+      if (value.has_value()) {
+        MUTILS_ASSERT_LT(size_t(value->value), size, "A value of the machine is out of range of the counts");
+      }
+    }
+  }
+
+  template <bool CAPTURES> find_result find_impl(std::span<input_t> input, capture_positions* captured) const {
+#define err(msg)                                                                                                       \
+  if constexpr (ON_MATCH_ERROR == MatchErrorMode::Panic) mutils::PANIC(msg);                                           \
+  else return {msg};
+
+    size_t current_node               = 1;
+    size_t most_specific_matched_node = 0;
+    size_t match_begin                = 0;
+    size_t match_end                  = 0;
+
+    // the input before this index has already been fed through the utf validator,
+    // restarting a failed match walks back over it without validating it twice
+    size_t validated = 0;
+    utf_validator uv;
+    [[maybe_unused]] ScopedMatchStats<Stats_T> stats(m_stats);
+
+    // the captures of the current attempt, copied to 'captured' whenever a longer match is found
+    [[maybe_unused]] capture_positions attempt;
+    if constexpr (CAPTURES) {
+      attempt.enter(m_nodes[0], 0);
+    }
+
+    // reset the current_node, and try to match from scratch
+    // starting one element after the failed attempt, as a match may begin partway through it
+    auto const restart_attempt = [&] {
+      if constexpr (Stats_T::ENABLED) {
+        stats.local.restarts++;
+      }
+      size_t restart = match_begin + 1;
+      if constexpr (IS_UTF8) {
+        // never restart in the middle of a codepoint
+        while (restart < validated && (input[restart] & 0b11000000) == 0b10000000) {
+          restart++;
+        }
+      }
+      current_node = 1;
+      match_begin  = restart;
+      match_end    = restart;
+      if constexpr (CAPTURES) {
+        attempt = {};
+        attempt.enter(m_nodes[0], restart);
+      }
+      return restart;
+    };
+
+    for (size_t i = 0;; i++) {
+      if (i == input.size()) {
+        // the input ran out partway through an attempt, which fails like a missing transition would
+        if (most_specific_matched_node == 0 && match_begin + 1 < input.size()) {
+          i = restart_attempt() - 1;
+          continue;
+        }
         break;
       }
-    }
-  }
-
-  void remove_duplicates() {
-    // This action has to be applied multiple times as nodes have the tendency
-    // to form chains which are easily simplifiable
-    while (remove_duplicates_once()) {}
-  }
-
-  bool remove_duplicates_once() {
-    bool has_removed_dup = false;
-
-    std::vector<bool> cursors(m_nodes.size(), false);
+      auto& transition = input[i];
+      auto& node       = m_nodes[current_node - 1];
 
-    for (auto c : construction_state.cursors) {
-      cursors[c - 1] = true;
-    }
-    // reverse iterate over every node excluding the root
-    for (auto noderef = m_nodes.rbegin(); noderef < m_nodes.rend() - 1; noderef++) {
+      if constexpr (Stats_T::ENABLED) {
+        stats.local.bytes_scanned++;
+      }
 
-      Node_T& node  = *noderef;
-      auto node_idx = node_index(node);
-      // skip pure nulls (nulls without cursors on them)
-      if (node.is_null() && !cursors[node_idx - 1]) {
-        continue;
+      if constexpr (IS_UTF8) {
+        if (i >= validated) {
+          auto error = uv.next(transition);
+          if (error != utf_validator::None) {
+            err(utf_validator::err_to_msg(error));
+          }
+          validated = i + 1;
+        }
       }
 
 
-      std::vector<size_t> matchers;
-      // check every other node
-      std::for_each(m_nodes.begin() + 1, noderef.base() - 1, [&](Node_T& other) {
-        auto other_idx = node_index(other);
+      auto loc = node.rt_get_transition(transition);
 
-        if (other.is_null() && !cursors[other_idx - 1]) {
-          return;
-        }
+      if (loc != 0) {
+        // go one iteration deeper and continue
+        current_node = loc;
 
-        if (cursors[other_idx - 1] != cursors[node_idx - 1]) {
-          // both dont have the same cursor state
-          return;
+        if constexpr (CAPTURES) {
+          attempt.enter(m_nodes[current_node - 1], i + 1);
         }
-        if (node.value != other.value) {
-          return;
-        }
-        // We also consider nodes to be equal if transitions are self-referring
-        bool equal = true;
-        node.each_transition([&](auto k, auto& node_tzn) {
-          if (!equal) {
-            return;
-          }
-          auto other_tzn = other.transition(k);
-
-          const bool node_tzn_is_self_referencing  = node_tzn == node_idx;
-          const bool other_tzn_is_self_referencing = other_tzn == other_idx;
-          bool both_are_self_referencing           = node_tzn_is_self_referencing && other_tzn_is_self_referencing;
 
-          if (both_are_self_referencing) {
-            // equality holds if they both refer to themselves
-            return;
-          } else if (node_tzn == other_tzn) {
-            // equality still holds when they both refer to the same node
-          } else {
-            // they are not equal
-            equal = false;
+        // update the most specific node
+        if (m_nodes[current_node - 1].value.has_value()) {
+          most_specific_matched_node = current_node;
+          match_end                  = i + 1;
+          if constexpr (CAPTURES) {
+            *captured = attempt;
           }
-        });
-        if (equal) {
-          matchers.push_back(other_idx);
-        } else {
         }
-      });
 
-      // not equal to end iterator (i.e exists)
-      if (matchers.size()) {
+        if constexpr (Stats_T::ENABLED) {
+          count_transition(stats.local, node, transition, current_node);
+        }
+      } else if (most_specific_matched_node == 0) {
+        i = restart_attempt() - 1;
+        continue;
+      } else if (most_specific_matched_node != 0) {
+        // we have a match, just return that
+        break;
+      }
+    }
 
-        has_removed_dup = true;
+    // a sequence may only be truncated if the entire input was consumed
+    if constexpr (IS_UTF8) {
+      auto error = uv.final();
+      if (validated == input.size() && error != utf_validator::None) {
+        err(utf_validator::err_to_msg(error));
+      }
+    }
 
-        for (auto old_idx : matchers) {
-          auto new_idx = node_index(node);
-          for (Node_T& n : m_nodes) {
-            n.each_transition([&](auto k, auto& v) {
-              if (v == old_idx) {
-                v = new_idx;
-              }
-            });
-          }
-          get_node(old_idx).nullify();
-          cursors[old_idx - 1] = false;
-          // std::cout << "DELETING: " << old_idx << "\n";
+    if (most_specific_matched_node) {
+      auto& node = m_nodes[most_specific_matched_node - 1];
+      auto& val  = node.value.value();
+      // the trailing context never extends before the start of the match
+      match_end -= std::min(val.back_by, match_end - match_begin);
+      auto range = std::span<input_t>(input.begin() + match_begin, input.begin() + match_end);
+      if constexpr (!IS_REGEX) {
+        return find_result(range, &val.value);
+      } else {
+        return find_result(range);
+      }
+    } else {
+      if constexpr (ON_MATCH_ERROR == MatchErrorMode::Return) {
+        return find_result(nullptr);
+      } else if constexpr (ON_MATCH_ERROR == MatchErrorMode::Panic) {
+        return find_result();
+      } else {
+        []<bool flag = false>() {
+          static_assert(flag, "Variant not handled");
         }
+        ();
       }
     }
+#undef err
+  }
 
-    construction_state.cursors = {};
-    size_t i                   = 1;
-    for (bool c : cursors) {
-      if (c) {
-        construction_state.cursors.push_back(i);
-      }
-      i++;
+  static std::uint16_t capture_bit(size_t group) {
+    if (group >= MAX_CAPTURE_GROUPS) {
+      mutils::PANIC("Capture group " + std::to_string(group) + " exceeds the limit of " +
+                    std::to_string(MAX_CAPTURE_GROUPS) + " groups");
     }
-    return has_removed_dup;
+    return std::uint16_t(1) << group;
+  }
+
+  size_t live_node_count() const {
+    size_t count = 0;
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+      count += !m_nodes[i].is_null();
+    }
+    return count;
   }
 
   ///
-  /// Traverses the tree and marks any unreachable nodes as null
+  /// Account for a scratch buffer allocated by the running pass
   ///
-  void nullify_orphans() {
-    std::vector<bool> reachables(m_nodes.size(), false);
-    reachables[0] = true; // root node is always reachable
+  template <typename T, typename A> void note_scratch(std::vector<T, A> const& buffer)
+    requires IS_DYNAMIC
+  {
+    if (construction_state.trace_sink) {
+      if constexpr (std::is_same_v<T, bool>) {
+        construction_state.scratch_bytes += (buffer.capacity() + 7) / 8;
+      } else {
+        construction_state.scratch_bytes += buffer.capacity() * sizeof(T);
+      }
+    }
+  }
 
-    while (true) {
-      bool has_expanded = false;
-      for (Node_T& n : m_nodes) {
-        if (reachables[node_index(n) - 1]) {
-          n.each_transition([&](auto k, auto& t) {
-            const size_t corrected_transition = t - 1;
-            if (reachables[corrected_transition]) {
-              return;
-            }
-            reachables[corrected_transition] = true;
-            has_expanded                     = true;
-          });
-        }
+  ///
+  /// Product construction shared by intersect() and subtract()
+  ///
+  /// with 'difference' set, pairs whose 'other' state is dead are kept, as this machine may still accept there
+  ///
+  Self_T product(Self_T const& other_machine, bool difference) const
+    requires IS_DYNAMIC
+  {
+    // work on copies, as the node accessors are not const
+    Self_T a = *(Self_T const*)this;
+    Self_T b = other_machine;
+    Self_T out;
+    auto& nodes = static_cast<StateMachine&>(out).m_nodes;
+
+    using Pair                   = std::pair<size_t, size_t>;
+    std::map<Pair, size_t> index = {{{ROOT_STATE, ROOT_STATE}, 1}};
+    std::vector<Pair> worklist   = {{ROOT_STATE, ROOT_STATE}};
+    auto const state_of          = [&](Pair p) {
+      auto [found, inserted] = index.try_emplace(p, nodes.size() + 1);
+      if (inserted) {
+        nodes.push(Node_T());
+        worklist.push_back(p);
       }
-      if (!has_expanded) {
-        break;
+      return found->second;
+    };
+    // the state reached by the key, falling back to the default transition as matching does
+    auto const target = [](StateMachine& m, size_t s, typename Node_T::Key_T key) -> size_t {
+      if (s == 0) {
+        return 0;
       }
-    }
+      auto& node                 = m.get_node(s);
+      auto const explicit_target = node.transition(key);
+      if (explicit_target == 0 && key.is_value()) {
+        return node.transition(Node_T::Key_T::def());
+      }
+      return explicit_target;
+    };
 
-    for (auto& c : construction_state.cursors) {
-      if (!reachables[c]) {
-        c = 0;
+    while (!worklist.empty()) {
+      auto const [sa, sb] = worklist.back();
+      worklist.pop_back();
+      auto const idx = index[{sa, sb}];
+
+      // every key with a transition of its own in either state
+      std::vector<typename Node_T::Key_T> keys = {Node_T::Key_T::def(), Node_T::Key_T::eof()};
+      std::vector<std::uint64_t> seen;
+      auto const collect = [&](StateMachine& m, size_t s) {
+        if (s == 0) {
+          return;
+        }
+        m.get_node(s).each_transition([&](auto k, auto&) {
+          if (k.is_value() && std::find(seen.begin(), seen.end(), k.ordinal()) == seen.end()) {
+            seen.push_back(k.ordinal());
+            keys.push_back(k);
+          }
+        });
+      };
+      collect(a, sa);
+      collect(b, sb);
+
+      for (auto key : keys) {
+        auto const ta = target(a, sa, key);
+        auto const tb = target(b, sb, key);
+        if (ta == 0 || (tb == 0 && !difference)) {
+          continue;
+        }
+        auto const to                  = state_of({ta, tb});
+        nodes[idx - 1].transition(key) = to;
       }
-    }
-    for (auto i = 0; i < m_nodes.size(); i++) {
-      if (!reachables[i]) {
-        m_nodes[i].nullify();
+
+      auto const& value_a = a.get_node(sa).value;
+      bool const accept_b = sb != 0 && b.get_node(sb).value.has_value();
+      if (value_a.has_value() && accept_b != difference) {
+        nodes[idx - 1].value = value_a;
       }
     }
 
-    std::vector<size_t> new_cursors;
-    std::copy_if(construction_state.cursors.begin(),
-                 construction_state.cursors.end(),
-                 std::back_inserter(new_cursors),
-                 [&](auto c) {
-                   return c != 0;
-                 });
-    construction_state.cursors = new_cursors;
+    out.construction_state.cursors = {ROOT_STATE};
+    out.optimize();
+    return out;
   }
 
-  void remove_blanks()
+  ///
+  /// Reorders the node table, 'order' lists every current node index in its new position
+  /// and must begin with the root
+  ///
+  void renumber(std::vector<size_t> const& order)
     requires IS_DYNAMIC
   {
-    // remove any nodes containing no data, and clear all references to them
+    MUTILS_ASSERT_EQ(order.size(), m_nodes.size(), "A renumbering must place every node");
+    MUTILS_ASSERT_EQ(order[0], 1, "The root must remain the first node");
+
     StateMachineNodeStore<Node_T, 0> new_nodes;
     std::vector<size_t> mappings(m_nodes.size(), 0);
-    mappings[0] = 1;
-    size_t idx  = 1;
-    for (auto& node : m_nodes) {
-
-      // If the node is null. we do not keep it, the exception is the root node and any nodes with cursors
-      if (node.is_null() && node_index(node) != 1 && !has_cursor(idx)) {
-        continue;
-      }
-      new_nodes.push(node);
-
-      mappings[node_index(node) - 1] = idx;
-      idx++;
+    for (size_t i = 0; i < order.size(); i++) {
+      new_nodes.push(m_nodes[order[i] - 1]);
+      mappings[order[i] - 1] = i + 1;
     }
 
     for (Node_T& n : new_nodes) {
-
-      // remap transitions to reflect the new cursors
-      n.each_transition([&](auto key, auto& t) {
-        if (t != 0) {
-          t = mappings[t - 1];
-        }
+      n.each_transition([&](auto, auto& t) {
+        t = mappings[t - 1];
       });
     }
 
-    std::vector<size_t> new_cursors;
-    for (auto c : construction_state.cursors) {
-      auto mapped = mappings[c - 1];
-      new_cursors.push_back(mapped);
+    for (auto& c : construction_state.cursors) {
+      c = mappings[c - 1];
     }
-    construction_state.cursors = new_cursors;
-    m_nodes                    = new_nodes;
+    note_scratch(new_nodes.store);
+    note_scratch(mappings);
+    m_nodes = new_nodes;
+
+    // per-state counters are indexed by the old numbering
+    m_stats.resize(m_nodes.size());
   }
 
   //
@@ -1164,7 +3001,7 @@ protected:
     std::vector<size_t> terminals;
   };
 
-  ConsumeResult consume_regex_except_root(MutableRegex regex) {
+  ConsumeResult consume_regex_except_root(MutableRegex& regex) {
     std::map<size_t, size_t> mappings;
 
     std::vector<size_t> terminals;
@@ -1183,6 +3020,8 @@ protected:
       node->each_transition([&](auto k, auto& v) {
         n.transition(k) = v + base_index;
       });
+      n.capture_open  = node->capture_open;
+      n.capture_close = node->capture_close;
 
 
       m_nodes.push(n);
@@ -1195,7 +3034,11 @@ protected:
     return r;
   }
 
-  void merge_regex_into_machine(MutableRegex regex)
+  //
+  // Writes the regex at every cursor, and moves the cursors to its terminals
+  // every node merged with one of the 'stand_ins' takes its place from then on, and is appended to them
+  //
+  void merge_regex_into_machine(MutableRegex& regex, std::vector<size_t>* stand_ins = nullptr)
     requires IS_DYNAMIC
   {
     auto const base_idx = m_nodes.size() - 1;
@@ -1210,149 +3053,172 @@ protected:
     });
 
     // merge the pseudo-node into each of the current cursors
+    merged_nodes merged;
     for (auto cursor : construction_state.cursors) {
-      new_root_transitions.each_transition([&](auto key, auto& dest) {
-        auto new_terminals = make_nonambiguous_link(cursor, key, dest, terminals);
+      // captures opening (or closing) at the start of the regex start at the cursor
+      get_node(cursor).capture_open |= regex.m_nodes[0].capture_open;
+      get_node(cursor).capture_close |= regex.m_nodes[0].capture_close;
 
-        // add the new terminals to the terminals list
-        std::for_each(new_terminals.begin(), new_terminals.end(), [&](auto t) {
-          terminals.push_back(t);
-        });
+      new_root_transitions.each_transition([&](auto key, auto& dest) {
+        link_merged(cursor, key, dest, merged);
       });
     }
+    fill_merged(merged);
+
+    // add the merged terminals to the terminals list
+    for (auto t : merged.containing(terminals)) {
+      terminals.push_back(t);
+    }
+    if (stand_ins) {
+      for (auto n : merged.containing(*stand_ins)) {
+        stand_ins->push_back(n);
+      }
+    }
 
     // finally, we can update the insertion points (cursors) to be the terminals
     construction_state.cursors = terminals;
   }
 
-  // Makes an unambiguous transition, this is where the brunt of regex combination logic lives
-  // this function will never modify the 'to' node, but instead make clones whenever necessary
-  // returns any nodes that were created as a replacement to any of the 'watch_nodes'
   //
-  std::vector<size_t> make_nonambiguous_link(size_t from,
-                                             typename Node_T::Key_T transition,
-                                             size_t to,
+  // The nodes made by a batch of links, keyed by the set of pre-existing nodes each one merges
+  //
+  // merging two loops reaches the same set of nodes again, which then leads back to the same merged node
+  // only the nodes linked from are modified by a batch, and all of them are modified before any node is merged,
+  // so every merged node sees the final transitions of the nodes it merges
+  //
+  struct merged_nodes {
+    std::map<std::vector<size_t>, size_t> by_members;
+    std::map<size_t, std::vector<size_t>> members_of;
+    std::vector<size_t> unfilled;
+
+    std::vector<size_t> members(size_t node) const {
+      auto const found = members_of.find(node);
+      return found == members_of.end() ? std::vector<size_t>{node} : found->second;
+    }
 
-                                             std::vector<size_t> watch_nodes) {
+    // the merged nodes standing in for any of 'nodes', in the order they were made
+    std::vector<size_t> containing(std::vector<size_t> const& nodes) const {
+      std::vector<size_t> found;
+      for (auto const& [node, members] : members_of) {
+        if (std::find_first_of(members.begin(), members.end(), nodes.begin(), nodes.end()) != members.end()) {
+          found.push_back(node);
+        }
+      }
+      return found;
+    }
+  };
 
+  // Points the transition of 'from' at the union of its current target and 'to'
+  // the merged node is only allocated here, fill_merged() writes its transitions once the batch is complete
+  void link_merged(size_t from, typename Node_T::Key_T transition, size_t to, merged_nodes& merged) {
     MUTILS_ASSERT_NEQ(to, 0, "Tried to link to a null node");
     MUTILS_ASSERT_NEQ(from, 0, "Tried to link from a null node");
 
     // The pre-existing transitioned node
     auto current_target = get_node(from).transition(transition);
 
-
     // simplest case
     if (!current_target) {
       get_node(from).transition(transition) = to;
-      return {};
+      return;
     }
 
     // transition is already in place
     if (current_target == to) {
-      return {};
+      return;
     }
 
-    // Create a new node to replace the current transitioned node
-    // This node starts as an exact copy as the current transitioned node
-    // we then begin merging in transitions from the target node as well
-    // if any of these transitions collide, we run this function recursively
-    // which should resolve all ambiguity
-    //
-    // exceptions:
-    // If both transitions are found to be self-referring, we can skip it
-
-
-    Node_T& node = new_node();
-    auto nidx    = node_index(node);
-
-
-    std::vector<size_t> tracked_nodes;
-
-    // clone the current target to node
-    node = get_node(current_target);
-
-    // fix self-references
-    node.each_transition([&](auto k, auto& v) {
-      if (v == current_target) {
-        v = nidx;
-      }
-    });
-
-
-    // Update the tracked node list
-    if (std::find(watch_nodes.begin(), watch_nodes.end(), to) != watch_nodes.end()) {
-      tracked_nodes.push_back(nidx);
-    } else if (std::find(watch_nodes.begin(), watch_nodes.end(), current_target) != watch_nodes.end()) {
-      tracked_nodes.push_back(nidx);
+    auto members = merged.members(current_target);
+    for (auto m : merged.members(to)) {
+      members.push_back(m);
     }
+    std::sort(members.begin(), members.end());
+    members.erase(std::unique(members.begin(), members.end()), members.end());
+
+    auto existing = merged.by_members.find(members);
+    if (existing == merged.by_members.end()) {
+      auto nidx               = node_index(new_node());
+      existing                = merged.by_members.emplace(members, nidx).first;
+      merged.members_of[nidx] = members;
+      merged.unfilled.push_back(nidx);
+    }
+    get_node(from).transition(transition) = existing->second;
+  }
 
-
-    Node_T& to_node = get_node(to);
-
-
-    // Handle node value propogation
-    if (to_node.value.has_value()) {
-      if (node.value.has_value()) {
-        switch (construction_state.on_conflict) {
-          case ConflictAction::Error: {
-            mutils::PANIC("Conflicting values have been encountered while making nonambiguous transition: " +
-                          std::to_string(from) + " -> " + std::to_string(to) + " (via " +
-                          mutils::stringify(transition) + "\n");
-            break;
-          }
-          case ConflictAction::Skip: {
-            break;
+  // Writes every merged node as the union of the nodes it merges, merging their children in turn
+  void fill_merged(merged_nodes& merged) {
+    // filled in creation order, which keeps the numbering of the nodes deterministic
+    for (size_t i = 0; i < merged.unfilled.size(); i++) {
+      auto const nidx    = merged.unfilled[i];
+      auto const members = merged.members_of[nidx];
+
+      get_node(nidx) = get_node(members[0]);
+      for (size_t m = 1; m < members.size(); m++) {
+        Node_T& other = get_node(members[m]);
+
+        // the merged state takes part in the captures of both paths
+        get_node(nidx).capture_open |= other.capture_open;
+        get_node(nidx).capture_close |= other.capture_close;
+
+        // Handle node value propogation
+        if (other.value.has_value()) {
+          auto& value = get_node(nidx).value;
+          if (!value.has_value()) {
+            value = other.value;
+          } else if (!(value.value() == other.value.value())) {
+            switch (construction_state.on_conflict) {
+              case ConflictAction::Error: {
+                mutils::PANIC("Conflicting values have been encountered while merging node #" +
+                              std::to_string(members[m]) + " into node #" + std::to_string(members[0]));
+                break;
+              }
+              case ConflictAction::Skip: {
+                break;
+              }
+              case ConflictAction::Overwrite: {
+                value = other.value;
+                break;
+              }
+            }
           }
-          case ConflictAction::Overwrite: {
-            node.value = to_node.value;
-            break;
+        }
+
+        for (auto [key, reference] : get_node(members[m]).get_transitions()) {
+          if (reference != 0) {
+            link_merged(nidx, key, reference, merged);
           }
         }
-      } else {
-        node.value = to_node.value;
       }
     }
+  }
 
-    // copy in the target node transitions to the newly created intermediary node
-    // purity means that a nodes transition intents will remain after further writes
-    // without it, we may accidentally introduce new transitions and thus unexpected machine state paths
-    for (auto [key, reference] : get_node(to).get_transitions()) {
-      // The base is circular and we are null,
-      // ensure the base maintains purity by changing it from
-      // a self-ref to an original-ref
-      auto& node_transition = get_node(nidx).transition(key);
-      if (node_transition == nidx && reference == 0) {
-        node_transition = current_target;
-      }
-
-      // We are circular and base is null
-      // we maintiain purity by writing our transition
-      else if (reference == to && node_transition == 0) {
-        node_transition = current_target;
-      }
+  // Makes a single unambiguous transition, as a batch of one for link_merged() and fill_merged(), where the
+  // combination logic lives. The 'to' node is never modified, merged clones are made whenever necessary
+  // returns any nodes that were created as a replacement to any of the 'watch_nodes'
+  //
+  std::vector<size_t> make_nonambiguous_link(size_t from,
+                                             typename Node_T::Key_T transition,
+                                             size_t to,
 
-      // We are both circular
-      // the node can just refer to itself
-      else if (reference == to && node_transition == nidx) {
-        // Already refers to self, so continue
-      }
+                                             std::vector<size_t> watch_nodes) {
+    merged_nodes merged;
+    link_merged(from, transition, to, merged);
+    fill_merged(merged);
+    return merged.containing(watch_nodes);
+  }
 
-      // skip null
-      else if (reference == 0) {
-      } else {
-        auto res = make_nonambiguous_link(nidx, key, reference, watch_nodes);
-        //
-        for (auto n : res) {
-          tracked_nodes.push_back(n);
+  // The key of the first transition match_any_of() makes for 'choice', its leading byte for utf8 machines
+  static typename Node_T::Key_T leading_key(Transition_T choice) {
+    if constexpr (IS_UTF8) {
+      constexpr char32_t byte      = 0xFF;
+      constexpr char32_t drop_mask = 0b10111111;
+      for (int shift : {24, 16, 8}) {
+        if (choice & (byte << shift)) {
+          return Node_T::Key_T::value((choice >> shift) & drop_mask);
         }
       }
     }
-
-    // set the transition
-    get_node(from).transition(transition) = nidx;
-
-    return tracked_nodes;
+    return Node_T::Key_T::value(choice);
   }
 
   ///
@@ -1360,7 +3226,9 @@ protected:
   ///
   /// a lot of behavior derived from make_nonambiguous_link
   ///
-  void cursor_discreet_transition(typename Node_T::Key_T transition) {
+  /// every node cloned here is appended to 'clones', paired with the node it was cloned from
+  ///
+  void cursor_discreet_transition(typename Node_T::Key_T transition, std::vector<std::pair<size_t, size_t>>& clones) {
     std::vector<size_t> cursors_with_child;
     std::vector<size_t> cursors_without_child;
     std::vector<size_t> cursors_with_default;
@@ -1400,19 +3268,7 @@ protected:
         auto& intermediary = new_node();
         intermediary       = get_node(old_target);
         auto inter_idx     = node_index(intermediary);
-
-
-        //
-        // If the old transition used to refer immediately to itself
-        // we have to update the corresponding transition in the clone to refer to itself
-        // if this did not happen, when the transition is met twice in a row, we are brought out
-        // of the matched state, requiring another transition to go back in.
-        // With this fix, making the same transition immediately after getting out of a loop will
-        // bring you back to the same place where you can transition again
-        //
-        if (old_target == cursor) {
-          intermediary.transition(transition) = inter_idx;
-        }
+        clones.push_back({inter_idx, old_target});
 
         // finally, rereference the cursor transition to point to the newly created intermediary
         get_node(cursor).transition(transition) = inter_idx;
@@ -1460,6 +3316,7 @@ protected:
         // this has to be done in a separate stage to allow cross-dependencies to properly operate
 
         get_node(ci.node) = get_node(ci.clone_from);
+        clones.push_back({ci.node, ci.clone_from});
       }
     }
     construction_state.cursors = new_cursors;
@@ -0,0 +1,194 @@
+// Copyright (c) 2023 Samir Bioud
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace regex_backend::internal {
+
+///
+/// Case folding applied by match_any_of() / match_sequence() while building a machine
+///
+/// folding expands every character into all of its cases at construction time, so each case is simply
+/// another transition to the same state once optimized, and matching costs nothing extra
+///
+enum class CaseFolding {
+  None,   /// Match characters exactly as given
+  Ascii,  /// Fold [A-Z] and [a-z]
+  Unicode /// Simple (one to one) folding of ascii, latin-1, latin extended-a, greek and cyrillic letters
+};
+
+namespace case_fold {
+
+// Decodes the packed utf8 representation used by char32_t machines (see match_any_of) into a codepoint
+inline char32_t unpack_utf8(char32_t packed) {
+  if (packed & 0xFF000000) {
+    return ((packed >> 24) & 0x07) << 18 | ((packed >> 16) & 0x3F) << 12 | ((packed >> 8) & 0x3F) << 6 |
+           (packed & 0x3F);
+  }
+  if (packed & 0xFF0000) {
+    return ((packed >> 16) & 0x0F) << 12 | ((packed >> 8) & 0x3F) << 6 | (packed & 0x3F);
+  }
+  if (packed & 0xFF00) {
+    return ((packed >> 8) & 0x1F) << 6 | (packed & 0x3F);
+  }
+  return packed;
+}
+
+inline char32_t pack_utf8(char32_t cp) {
+  if (cp < 0x80) {
+    return cp;
+  }
+  if (cp < 0x800) {
+    return (0xC0 | (cp >> 6)) << 8 | (0x80 | (cp & 0x3F));
+  }
+  if (cp < 0x10000) {
+    return (0xE0 | (cp >> 12)) << 16 | (0x80 | ((cp >> 6) & 0x3F)) << 8 | (0x80 | (cp & 0x3F));
+  }
+  return (0xF0 | (cp >> 18)) << 24 | (0x80 | ((cp >> 12) & 0x3F)) << 16 | (0x80 | ((cp >> 6) & 0x3F)) << 8 |
+         (0x80 | (cp & 0x3F));
+}
+
+inline char32_t ascii_other_case(char32_t cp) {
+  if (cp >= 'A' && cp <= 'Z') {
+    return cp + 32;
+  }
+  if (cp >= 'a' && cp <= 'z') {
+    return cp - 32;
+  }
+  return cp;
+}
+
+// The other case of a codepoint under simple folding, or the codepoint itself
+inline char32_t unicode_other_case(char32_t cp) {
+  // latin-1 supplement, skipping the multiplication and division signs
+  if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) {
+    return cp + 0x20;
+  }
+  if (cp >= 0xE0 && cp <= 0xFE && cp != 0xF7) {
+    return cp - 0x20;
+  }
+  if (cp == 0xFF) {
+    return 0x178;
+  }
+  if (cp == 0x178) {
+    return 0xFF;
+  }
+
+  // latin extended-a, alternating upper / lower pairs. The dotted İ and dotless ı are not a pair, they only fold to
+  // 'i' and 'I' under turkic rules
+  if ((cp >= 0x100 && cp <= 0x12F) || (cp >= 0x132 && cp <= 0x137) || (cp >= 0x14A && cp <= 0x177)) {
+    return cp ^ 1;
+  }
+  if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) {
+    return (cp & 1) ? cp + 1 : cp - 1;
+  }
+
+  // greek, including the letters with dialytika, the final sigma is handled by case_variants()
+  if (cp >= 0x391 && cp <= 0x3AB && cp != 0x3A2) {
+    return cp + 0x20;
+  }
+  if (cp >= 0x3B1 && cp <= 0x3CB && cp != 0x3C2) {
+    return cp - 0x20;
+  }
+
+  // greek letters with tonos
+  switch (cp) {
+    case 0x386: return 0x3AC;
+    case 0x388: return 0x3AD;
+    case 0x389: return 0x3AE;
+    case 0x38A: return 0x3AF;
+    case 0x38C: return 0x3CC;
+    case 0x38E: return 0x3CD;
+    case 0x38F: return 0x3CE;
+    case 0x3AC: return 0x386;
+    case 0x3AD: return 0x388;
+    case 0x3AE: return 0x389;
+    case 0x3AF: return 0x38A;
+    case 0x3CC: return 0x38C;
+    case 0x3CD: return 0x38E;
+    case 0x3CE: return 0x38F;
+  }
+
+  // cyrillic
+  if (cp >= 0x400 && cp <= 0x40F) {
+    return cp + 0x50;
+  }
+  if (cp >= 0x410 && cp <= 0x42F) {
+    return cp + 0x20;
+  }
+  if (cp >= 0x430 && cp <= 0x44F) {
+    return cp - 0x20;
+  }
+  if (cp >= 0x450 && cp <= 0x45F) {
+    return cp - 0x50;
+  }
+  return ascii_other_case(cp);
+}
+
+} // namespace case_fold
+
+///
+/// Expands a set of transition characters to every case of each character, duplicates are removed
+///
+template <typename Transition_T>
+std::vector<Transition_T> case_variants(std::vector<Transition_T> const& options, CaseFolding folding) {
+  std::vector<Transition_T> out;
+  for (auto option : options) {
+    out.push_back(option);
+    if (folding == CaseFolding::None) {
+      continue;
+    }
+    if constexpr (std::is_same_v<Transition_T, char32_t>) {
+      auto const cp = case_fold::unpack_utf8(option);
+      if (folding == CaseFolding::Ascii) {
+        out.push_back(case_fold::ascii_other_case(cp));
+        continue;
+      }
+      out.push_back(case_fold::pack_utf8(case_fold::unicode_other_case(cp)));
+      // sigma has two lowercase forms
+      if (cp == 0x3A3 || cp == 0x3C3 || cp == 0x3C2) {
+        out.push_back(case_fold::pack_utf8(0x3A3));
+        out.push_back(case_fold::pack_utf8(0x3C3));
+        out.push_back(case_fold::pack_utf8(0x3C2));
+      }
+    } else {
+      // single byte machines only ever hold ascii letters
+      out.push_back((Transition_T)case_fold::ascii_other_case((unsigned char)option));
+    }
+  }
+
+  // keep the first occurrence of each option, preserving the given order
+  std::vector<Transition_T> unique;
+  for (auto o : out) {
+    if (std::find(unique.begin(), unique.end(), o) == unique.end()) {
+      unique.push_back(o);
+    }
+  }
+  return unique;
+}
+
+} // namespace regex_backend::internal
@@ -0,0 +1,93 @@
+// Copyright (c) 2023 Samir Bioud
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace regex_backend::internal {
+
+///
+/// A breakdown of the memory held by a state machine
+///
+/// byte counts cover the machine and the heap allocations it owns, except for any heap memory
+/// owned by user values themselves (e.g the contents of a std::string value)
+///
+struct MemoryUsage {
+  size_t transition_bytes   = 0; // transition tables, including map entries for non-byte transition types
+  size_t value_bytes        = 0; // node values (and their back_by / terminal flags)
+  size_t construction_bytes = 0; // builder-only state, such as cursors
+  size_t overhead_bytes     = 0; // everything else: unused capacity, padding, instrumentation and the object itself
+
+  size_t node_count          = 0;
+  size_t transition_slots    = 0; // transition entries held across all nodes, whether set or not
+  size_t nonzero_transitions = 0; // transition entries which lead to a node
+  size_t byte_classes        = 0; // groups of input keys which every node treats identically
+
+  size_t total_bytes() const {
+    return transition_bytes + value_bytes + construction_bytes + overhead_bytes;
+  }
+
+  ///
+  /// The fraction of transition entries which are set, a low density suggests the machine would
+  /// be smaller with byte classes or a sparse transition representation
+  ///
+  double transition_density() const {
+    return transition_slots == 0 ? 0 : (double)nonzero_transitions / transition_slots;
+  }
+};
+
+///
+/// Counts the byte classes (a.k.a equivalence classes) of a machine
+///
+/// every node reports the value transitions which do not simply fall back to its default, keys reporting
+/// the exact same (node, target) pairs fall into one class, as do all keys which are never reported
+///
+template <typename Key_T> class ByteClassCounter {
+  std::map<Key_T, std::vector<std::pair<size_t, size_t>>> columns;
+
+public:
+  ///
+  /// Nodes must be added in ascending order
+  ///
+  void add(Key_T key, size_t node, size_t target) {
+    columns[key].emplace_back(node, target);
+  }
+
+  ///
+  /// 'keyspace' is the number of distinct keys, or 0 when unbounded
+  ///
+  size_t count(size_t keyspace) const {
+    std::set<std::vector<std::pair<size_t, size_t>>> distinct;
+    for (auto const& [key, column] : columns) {
+      distinct.insert(column);
+    }
+    bool const has_unused_keys = keyspace == 0 || columns.size() < keyspace;
+    return distinct.size() + has_unused_keys;
+  }
+};
+
+}; // namespace regex_backend::internal
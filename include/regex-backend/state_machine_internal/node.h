@@ -26,9 +26,11 @@
 #include "node_store.h"
 #include <array>
 #include <bit>
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <optional>
+#include <type_traits>
 #include <variant>
 #include <vector>
 
@@ -103,6 +105,21 @@ public:
     return k;
   }
 
+  bool is_value() const {
+    return kind == Val;
+  }
+
+  ///
+  /// A distinct integer for every key, eof and default sort after every value
+  ///
+  std::uint64_t ordinal() const {
+    switch (kind) {
+      case Eof: return std::uint64_t(1) << 32;
+      case Def: return (std::uint64_t(1) << 32) + 1;
+      default: return static_cast<std::make_unsigned_t<Key_T>>(val.value());
+    }
+  }
+
   operator std::string() const {
     switch (kind) {
       case Eof: return "<EOF>";
@@ -148,6 +165,10 @@ private:
 public:
   std::optional<Value_T> value;
 
+  // capture groups opened / closed upon entering this state, one bit per group
+  std::uint16_t capture_open  = 0;
+  std::uint16_t capture_close = 0;
+
   void nullify()
     requires DYNAMIC
   {
@@ -155,6 +176,8 @@ public:
     transitions.clear();
     eof_transition     = 0;
     default_transition = 0;
+    capture_open       = 0;
+    capture_close      = 0;
   }
 
   bool is_null() const {
@@ -232,6 +255,10 @@ public:
     return default_transition;
   }
 
+  size_t get_def() const {
+    return default_transition;
+  }
+
   ///
   /// Function for trivially accessing transitions
   /// NOTE: Not really suitable for runtime purposes
@@ -258,6 +285,58 @@ public:
       return default_transition;
     }
   }
+
+  ///
+  /// Whether the key has a transition of its own, rather than relying on the default transition
+  ///
+  bool rt_has_explicit_transition(Transition_T key) const {
+    return transitions.find(key) != transitions.end();
+  }
+
+  ///
+  /// Bytes held by the transitions of this node, including the heap allocated map entries
+  /// NOTE: map entries are estimated as the entry itself, plus the usual tree node links and colour
+  ///
+  size_t transition_bytes() const {
+    return sizeof(transitions) + sizeof(eof_transition) + sizeof(default_transition) + transition_heap_bytes();
+  }
+
+  size_t transition_heap_bytes() const {
+    return transitions.size() * (sizeof(typename TransitionMap_T::value_type) + 4 * sizeof(void*));
+  }
+
+  size_t transition_slots() const {
+    return transitions.size() + 2;
+  }
+
+  size_t nonzero_transitions() const {
+    size_t count = (eof_transition != 0) + (default_transition != 0);
+    for (auto const& [k, v] : transitions) {
+      count += v != 0;
+    }
+    return count;
+  }
+
+  size_t default_target() const {
+    return default_transition;
+  }
+
+  ///
+  /// Iterate over every explicit value transition without mutating them
+  ///
+  template <typename F> void each_value_transition(F&& callback) const {
+    for (auto const& [k, v] : transitions) {
+      if (v != 0) {
+        callback(k, v);
+      }
+    }
+  }
+
+  ///
+  /// The number of distinct value keys, or 0 when unbounded
+  ///
+  static constexpr size_t KEYSPACE = 0;
+  using ValueKey_T                  = Transition_T;
 };
 
 ///
@@ -292,11 +371,17 @@ public:
 
   std::optional<Value_T> value;
 
+  // capture groups opened / closed upon entering this state, one bit per group
+  std::uint16_t capture_open  = 0;
+  std::uint16_t capture_close = 0;
+
   void nullify()
     requires DYNAMIC
   {
     value = {};
     transitions.fill(0);
+    capture_open  = 0;
+    capture_close = 0;
   }
 
   bool is_null() const {
@@ -398,6 +483,14 @@ public:
     return transitions[def_idx];
   }
 
+  size_t get_def() const {
+    if constexpr (DYNAMIC) {
+      return transitions[def_idx];
+    } else {
+      return 0;
+    }
+  }
+
   ///
   /// Function for trivially accessing transitions
   /// NOTE: Not really suitable for runtime purposes
@@ -416,7 +509,7 @@ public:
   __attribute__((always_inline))
   size_t rt_get_transition(Transition_T key) const{
 
-    auto result = UTF8 ? transitions[key & 0b10000000 ? key & 0b10111111 : key] : transitions[key];
+    auto result = UTF8 ? transitions[key & 0b10000000 ? key & 0b10111111 : key] : explicit_ascii_transition(key);
 
     if(result != 0){
       return result;
@@ -428,6 +521,64 @@ public:
     }
   }
 
+  ///
+  /// Whether the key has a transition of its own, rather than relying on the default transition
+  ///
+  bool rt_has_explicit_transition(Transition_T key) const {
+    return (UTF8 ? transitions[key & 0b10000000 ? key & 0b10111111 : key] : explicit_ascii_transition(key)) != 0;
+  }
+
+  ///
+  /// bytes outside of the ascii range have no transitions of their own on char nodes
+  ///
+  size_t explicit_ascii_transition(Transition_T key) const {
+    return (unsigned char)key < KEYSPACE_SIZE ? transitions[(unsigned char)key] : 0;
+  }
+
+  size_t transition_bytes() const {
+    return sizeof(transitions);
+  }
+
+  size_t transition_heap_bytes() const {
+    return 0;
+  }
+
+  size_t transition_slots() const {
+    return transitions.size();
+  }
+
+  size_t nonzero_transitions() const {
+    size_t count = 0;
+    for (auto t : transitions) {
+      count += t != 0;
+    }
+    return count;
+  }
+
+  size_t default_target() const {
+    if constexpr (DYNAMIC) {
+      return transitions[def_idx];
+    }
+    return 0;
+  }
+
+  ///
+  /// Iterate over every explicit value transition without mutating them, keys are given in their compact form
+  ///
+  template <typename F> void each_value_transition(F&& callback) const {
+    for (size_t c = 0; c < KEYSPACE_SIZE; c++) {
+      if (transitions[c] != 0) {
+        callback(c, transitions[c]);
+      }
+    }
+  }
+
+  ///
+  /// The number of distinct value keys, or 0 when unbounded
+  ///
+  static constexpr size_t KEYSPACE = KEYSPACE_SIZE;
+  using ValueKey_T                  = size_t;
+
 private:
   size_t& get_utf8_transition(char32_t key, StateMachineNodeStore<StateMachineNode, 0>& store) {
     // our key is essentially just an array
@@ -22,9 +22,11 @@
 #pragma once
 
 
+#include <array>
 #include <cmath>
 #include <concepts>
 #include <cstddef>
+#include <new>
 #include <vector>
 #include "mutils/assert.h"
 
@@ -46,6 +48,32 @@ template <typename K_T, typename V_T> constexpr bool reasonable_expanded_allocat
   return total_size_bytes <= STORAGE_MAX_TRIVIAL_SIZE_BYTES;
 }
 
+constexpr size_t CACHE_LINE_SIZE_BYTES = 64;
+
+///
+/// Allocates node tables on a cache line boundary, so the first (and after relayout(), hottest)
+/// nodes of a table never straddle more cache lines than their size requires
+///
+template <typename T> struct CacheAlignedAllocator {
+  using value_type = T;
+
+  CacheAlignedAllocator() = default;
+  template <typename U> CacheAlignedAllocator(CacheAlignedAllocator<U> const&) {
+  }
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{CACHE_LINE_SIZE_BYTES}));
+  }
+
+  void deallocate(T* p, size_t) {
+    ::operator delete(p, std::align_val_t{CACHE_LINE_SIZE_BYTES});
+  }
+
+  template <typename U> bool operator==(CacheAlignedAllocator<U> const&) const {
+    return true;
+  }
+};
+
 template<typename Value_T, size_t SIZE>
 struct storage_t{
   using type = std::array<Value_T, SIZE>;
@@ -53,7 +81,7 @@ struct storage_t{
 
 template<typename Value_T>
 struct storage_t<Value_T, 0>{
-  using type = std::vector<Value_T>;
+  using type = std::vector<Value_T, CacheAlignedAllocator<Value_T>>;
 };
 
 template <typename Value_T, size_t SIZE = 0> struct StateMachineNodeStore {
@@ -69,6 +97,13 @@ template <typename Value_T, size_t SIZE = 0> struct StateMachineNodeStore {
     return SIZE;
   }
 
+  size_t capacity() const{
+    if constexpr(IS_DYNAMIC){
+      return store.capacity();
+    }
+    return SIZE;
+  }
+
   size_t indexof(Value_T& val) const{
     const auto idx = &val;
     const auto start = &store[0];
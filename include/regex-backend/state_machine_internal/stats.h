@@ -0,0 +1,195 @@
+// Copyright (c) 2023 Samir Bioud
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace regex_backend::internal {
+
+///
+/// A point-in-time copy of the counters held by a MatchStats policy
+///
+struct MatchStatsSnapshot {
+  std::uint64_t bytes_scanned       = 0; // input elements read by the match functions
+  std::uint64_t transitions         = 0; // transitions into a non-null node
+  std::uint64_t default_transitions = 0; // transitions which fell back to the default transition
+  std::uint64_t restarts            = 0; // times find() abandoned a partial match and restarted from the root
+  std::uint64_t accepts             = 0; // transitions landing on a node holding a value
+
+  ///
+  /// Visit counts indexed by node index - 1 (i.e the root is at index 0)
+  /// only covers the nodes present when the counters were last sized, see MatchStats::resize()
+  ///
+  std::vector<std::uint64_t> state_visits;
+};
+
+///
+/// The default instrumentation policy, every hook is a no-op and is compiled out entirely
+///
+struct NoMatchStats {
+  static constexpr bool ENABLED = false;
+
+  struct Local {};
+
+  void resize(std::size_t) {
+  }
+
+  void visit(std::size_t) const {
+  }
+
+  void flush(Local const&) const {
+  }
+
+  std::size_t heap_bytes() const {
+    return 0;
+  }
+};
+
+///
+/// Instrumentation policy which counts the work done by the match functions
+///
+/// counters are relaxed atomics, so a single machine may be shared between matching threads.
+/// The scalar counters are accumulated locally within a match call and flushed once at its end,
+/// per-state visits are counted as they happen
+///
+class MatchStats {
+  mutable std::atomic<std::uint64_t> bytes_scanned{0};
+  mutable std::atomic<std::uint64_t> transitions{0};
+  mutable std::atomic<std::uint64_t> default_transitions{0};
+  mutable std::atomic<std::uint64_t> restarts{0};
+  mutable std::atomic<std::uint64_t> accepts{0};
+
+  std::size_t state_count = 0;
+  std::unique_ptr<std::atomic<std::uint64_t>[]> state_visits;
+
+public:
+  static constexpr bool ENABLED = true;
+
+  ///
+  /// Counters for a single match call
+  ///
+  struct Local {
+    std::uint64_t bytes_scanned       = 0;
+    std::uint64_t transitions         = 0;
+    std::uint64_t default_transitions = 0;
+    std::uint64_t restarts            = 0;
+    std::uint64_t accepts             = 0;
+  };
+
+  MatchStats() = default;
+
+  MatchStats(MatchStats const& other) {
+    *this = other;
+  }
+
+  MatchStats& operator=(MatchStats const& other) {
+    if (this == &other) {
+      return *this;
+    }
+    auto snap = other.snapshot();
+    resize(snap.state_visits.size());
+    bytes_scanned.store(snap.bytes_scanned, std::memory_order_relaxed);
+    transitions.store(snap.transitions, std::memory_order_relaxed);
+    default_transitions.store(snap.default_transitions, std::memory_order_relaxed);
+    restarts.store(snap.restarts, std::memory_order_relaxed);
+    accepts.store(snap.accepts, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < state_count; i++) {
+      state_visits[i].store(snap.state_visits[i], std::memory_order_relaxed);
+    }
+    return *this;
+  }
+
+  ///
+  /// Clear every counter, and size the per-state counters for a machine of 'node_count' nodes
+  ///
+  /// NOTE: This is not thread-safe, and must not run concurrently with any match function
+  ///
+  void resize(std::size_t node_count) {
+    bytes_scanned.store(0, std::memory_order_relaxed);
+    transitions.store(0, std::memory_order_relaxed);
+    default_transitions.store(0, std::memory_order_relaxed);
+    restarts.store(0, std::memory_order_relaxed);
+    accepts.store(0, std::memory_order_relaxed);
+
+    state_count  = node_count;
+    state_visits = std::make_unique<std::atomic<std::uint64_t>[]>(node_count);
+    for (std::size_t i = 0; i < node_count; i++) {
+      state_visits[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void visit(std::size_t node) const {
+    if (node != 0 && node <= state_count) {
+      state_visits[node - 1].fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void flush(Local const& l) const {
+    bytes_scanned.fetch_add(l.bytes_scanned, std::memory_order_relaxed);
+    transitions.fetch_add(l.transitions, std::memory_order_relaxed);
+    default_transitions.fetch_add(l.default_transitions, std::memory_order_relaxed);
+    restarts.fetch_add(l.restarts, std::memory_order_relaxed);
+    accepts.fetch_add(l.accepts, std::memory_order_relaxed);
+  }
+
+  std::size_t heap_bytes() const {
+    return state_count * sizeof(std::atomic<std::uint64_t>);
+  }
+
+  MatchStatsSnapshot snapshot() const {
+    MatchStatsSnapshot snap;
+    snap.bytes_scanned       = bytes_scanned.load(std::memory_order_relaxed);
+    snap.transitions         = transitions.load(std::memory_order_relaxed);
+    snap.default_transitions = default_transitions.load(std::memory_order_relaxed);
+    snap.restarts            = restarts.load(std::memory_order_relaxed);
+    snap.accepts             = accepts.load(std::memory_order_relaxed);
+    snap.state_visits.resize(state_count);
+    for (std::size_t i = 0; i < state_count; i++) {
+      snap.state_visits[i] = state_visits[i].load(std::memory_order_relaxed);
+    }
+    return snap;
+  }
+};
+
+///
+/// Accumulates the counters of a single match call, and flushes them into the policy once the call returns
+///
+template <typename Stats_T> struct ScopedMatchStats {
+  Stats_T const& stats;
+  typename Stats_T::Local local;
+
+  explicit ScopedMatchStats(Stats_T const& s) : stats(s) {
+  }
+
+  ScopedMatchStats(ScopedMatchStats const&) = delete;
+
+  ~ScopedMatchStats() {
+    stats.flush(local);
+  }
+};
+
+}; // namespace regex_backend::internal
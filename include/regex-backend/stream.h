@@ -0,0 +1,219 @@
+// Copyright (c) 2023 Samir Bioud
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+// OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#pragma once
+
+#include "./state_machine.h"
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace regex_backend {
+
+///
+/// Runs find() over an input delivered in chunks, such as a socket or a file read piecewise
+///
+/// matches follow the same rules as StateMachine::find() and find_many(): the leftmost, longest match is reported,
+/// its trailing context (see exit_point()'s 'back_by') is left in the stream, and the search resumes right after
+/// the reported range. The machine's state is carried from one chunk to the next, so the input is never scanned
+/// again when a chunk ends partway through a match.
+///
+/// Only the elements of the attempt in progress are buffered, up to 'max_lookahead' of them. Once the bound is
+/// reached, the attempt is resolved as if the stream ended there: the longest match found so far is reported, or the
+/// search moves on, so a match longer than the bound is truncated to its longest exit point within it.
+///
+/// the buffer is reserved on construction, for the attempt in progress along with a chunk of up to 'max_chunk'
+/// elements, so feeding chunks no longer than that never allocates
+///
+/// matches of zero length (a trailing context covering the whole match) are never reported
+///
+/// the elements outside of matches may also be passed through, by giving feed() and finish() an 'on_gap' callback,
+/// which makes the matcher suitable for replacing matches over unbounded inputs (see StateMachine::replace_all())
+///
+/// NOTE: unlike find(), the stream does not validate utf8, malformed sequences simply fail to match
+///
+template <typename Machine_T> class StreamMatcher {
+public:
+  using input_t = typename Machine_T::input_t;
+
+  struct stream_match {
+    size_t offset;                   // offset of the match from the start of the stream
+    std::span<input_t const> range;  // the matched elements, only valid within the callback
+    size_t exit_state;               // the exit state, see StateMachine::exit_value()
+  };
+
+private:
+  static constexpr bool UTF8 = std::is_same_v<typename Machine_T::transition_t, char32_t>;
+
+  Machine_T const& m_machine;
+  size_t m_max_lookahead;
+
+  std::vector<input_t> m_buffer; // the attempt in progress begins at m_buffer[m_head]
+  size_t m_head = 0;
+  size_t m_base = 0;             // stream offset of m_buffer[m_head]
+  size_t m_gap  = 0;             // stream offset of the first element neither matched nor passed to on_gap
+
+  size_t m_state       = Machine_T::ROOT_STATE;
+  size_t m_scan        = 0; // elements of the attempt fed through the machine
+  size_t m_accept      = 0; // most specific exit state of the attempt, 0 when none was reached
+  size_t m_accept_size = 0; // elements of the attempt consumed up to m_accept
+
+  // pass the elements resolved so far without matching to on_gap
+  template <typename Gap> void flush_gap(Gap& on_gap) {
+    if (m_gap != m_base) {
+      on_gap(std::span<input_t const>(m_buffer.data() + m_head - (m_base - m_gap), m_base - m_gap));
+      m_gap = m_base;
+    }
+  }
+
+  template <typename Sink, typename Gap> void resolve(Sink& on_match, Gap& on_gap) {
+    size_t resume = 1;
+    if (m_accept != 0) {
+      auto const back_by = std::min(*m_machine.exit_back_by(m_accept), m_accept_size);
+      auto const size    = m_accept_size - back_by;
+      if (size != 0) {
+        flush_gap(on_gap);
+        on_match(stream_match{m_base, std::span<input_t const>(m_buffer.data() + m_head, size), m_accept});
+        resume = size;
+        m_gap += size;
+      }
+    }
+
+    if constexpr (UTF8) {
+      // never restart in the middle of a codepoint
+      while (m_head + resume < m_buffer.size() && (m_buffer[m_head + resume] & 0b11000000) == 0b10000000) {
+        resume++;
+      }
+    }
+    resume = std::min(resume, m_buffer.size() - m_head);
+
+    m_head += resume;
+    m_base += resume;
+    m_state       = Machine_T::ROOT_STATE;
+    m_scan        = 0;
+    m_accept      = 0;
+    m_accept_size = 0;
+  }
+
+  template <typename Sink, typename Gap> void scan(Sink& on_match, Gap& on_gap) {
+    while (m_head + m_scan < m_buffer.size()) {
+      auto const next = m_machine.step(m_state, m_buffer[m_head + m_scan]);
+      if (next == 0) {
+        resolve(on_match, on_gap);
+        continue;
+      }
+
+      m_state = next;
+      m_scan++;
+      if (m_machine.exit_back_by(next)) {
+        m_accept      = next;
+        m_accept_size = m_scan;
+      }
+      if (m_scan >= m_max_lookahead) {
+        resolve(on_match, on_gap);
+      }
+    }
+    flush_gap(on_gap);
+  }
+
+  void compact(size_t incoming) {
+    // drop the resolved elements once they outweigh the live ones, or to make room for the incoming ones without
+    // growing the buffer, keeping it bounded
+    bool const full = m_buffer.size() + incoming > m_buffer.capacity();
+    if (m_head != 0 && (full || m_head >= m_buffer.size() - m_head)) {
+      m_buffer.erase(m_buffer.begin(), m_buffer.begin() + m_head);
+      m_head = 0;
+    }
+  }
+
+public:
+  ///
+  /// 'machine' must outlive the matcher, and should be optimized beforehand
+  ///
+  explicit StreamMatcher(Machine_T const& machine, size_t max_lookahead = 1 << 16, size_t max_chunk = 1 << 12) :
+      m_machine(machine), m_max_lookahead(std::max<size_t>(max_lookahead, 1)) {
+    // the attempt in progress holds fewer than max_lookahead elements whenever a chunk is fed
+    m_buffer.reserve(m_max_lookahead + max_chunk);
+  }
+
+  ///
+  /// Feed the next chunk of the stream, 'on_match' is called with a stream_match for every match completed by it
+  ///
+  template <typename Sink> void feed(std::span<input_t const> chunk, Sink&& on_match) {
+    feed(chunk, on_match, [](std::span<input_t const>) {});
+  }
+
+  ///
+  /// Identical to feed(chunk, on_match), the elements of the stream outside of matches being passed to 'on_gap' as
+  /// std::span<input_t const>, in stream order with the matches, as soon as they are known not to begin one
+  ///
+  template <typename Sink, typename Gap> void feed(std::span<input_t const> chunk, Sink&& on_match, Gap&& on_gap) {
+    compact(chunk.size());
+    m_buffer.insert(m_buffer.end(), chunk.begin(), chunk.end());
+    scan(on_match, on_gap);
+  }
+
+  ///
+  /// End the stream, reporting the matches still pending within the buffered input
+  ///
+  template <typename Sink> void finish(Sink&& on_match) {
+    finish(on_match, [](std::span<input_t const>) {});
+  }
+
+  ///
+  /// Identical to finish(on_match), passing the elements left outside of matches to 'on_gap'
+  ///
+  template <typename Sink, typename Gap> void finish(Sink&& on_match, Gap&& on_gap) {
+    while (m_head < m_buffer.size()) {
+      resolve(on_match, on_gap);
+      scan(on_match, on_gap);
+    }
+    flush_gap(on_gap);
+    reset();
+  }
+
+  ///
+  /// Discard any buffered input and start a new stream
+  ///
+  void reset() {
+    m_buffer.clear();
+    m_head        = 0;
+    m_base        = 0;
+    m_gap         = 0;
+    m_state       = Machine_T::ROOT_STATE;
+    m_scan        = 0;
+    m_accept      = 0;
+    m_accept_size = 0;
+  }
+
+  ///
+  /// The number of elements currently held back waiting for more input
+  ///
+  size_t buffered() const {
+    return m_buffer.size() - m_head;
+  }
+};
+
+}; // namespace regex_backend
@@ -39,17 +39,4 @@ namespace regex_backend::internal::aliases {
  */
 template <typename Referred_T> using TransitionSet = std::array<Referred_T, 129>;
 
-
-// WIP
-// struct TransitionMetadata {
-//   bool consume_char  : 1 = true;
-//
-//   /**
-//   * Indicate to the state machine that it should begin eating characters into the next
-//   * of 16 capture group variables, terminates the previous capture if applicable
-//   */
-//   bool start_capture : 1 = false;
-//   bool end_capture   : 1 = false;
-// };
-
 }; // namespace regex_backend::internal::aliases
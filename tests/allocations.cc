@@ -0,0 +1,290 @@
+/// Copyright (c) 2023 Samir Bioud
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+/// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+/// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+/// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+/// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+/// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+/// OR OTHER DEALINGS IN THE SOFTWARE.
+///
+
+
+//
+// The match functions must never touch the heap once a machine is built,
+// this file replaces the global allocation functions with counting ones to enforce it
+//
+
+#include "regex-backend/builder.h"
+#include "regex-backend/state_machine.h"
+#include "regex-backend/stream.h"
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <new>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace {
+// only allocations made while a guard is alive are counted, gtest itself allocates freely
+thread_local bool counting          = false;
+thread_local std::size_t allocations = 0;
+
+void* counted_alloc(std::size_t size, std::size_t align) {
+  if (counting) {
+    allocations++;
+  }
+  void* p = align > alignof(std::max_align_t) ? std::aligned_alloc(align, (size + align - 1) / align * align)
+                                              : std::malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+///
+/// Counts the heap allocations made by the current thread during its lifetime
+///
+struct AllocationGuard {
+  AllocationGuard() {
+    allocations = 0;
+    counting    = true;
+  }
+
+  ~AllocationGuard() {
+    counting = false;
+  }
+
+  std::size_t count() const {
+    return allocations;
+  }
+};
+} // namespace
+
+void* operator new(std::size_t size) {
+  return counted_alloc(size, alignof(std::max_align_t));
+}
+
+void* operator new[](std::size_t size) {
+  return counted_alloc(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+  return counted_alloc(size, (std::size_t)align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+  return counted_alloc(size, (std::size_t)align);
+}
+
+// the other replacements forward to these two. GCC inlines them into delete expressions and, not seeing that
+// operator new is replaced by malloc as well, reports the std::free as mismatched
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+void operator delete(void* p, std::size_t) noexcept {
+  operator delete(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  operator delete[](p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  operator delete(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+  operator delete[](p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+  operator delete(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+  operator delete[](p);
+}
+
+using namespace regex_backend;
+
+TEST(allocations, counter_detects_allocations) {
+  AllocationGuard guard;
+  auto allocated = std::make_unique<int>(0);
+  ASSERT_EQ(guard.count(), 1) << "The harness itself must see allocations";
+}
+
+TEST(allocations, find_and_matches) {
+  StateMachine<void, char> machine;
+  machine.match_sequence("alpha").exit_point().root().match_sequence("alps").exit_point().optimize();
+
+  std::string input = "an alp, alps and alphabets";
+  std::string word  = "alpha";
+
+  AllocationGuard guard;
+  auto found   = machine.find(std::span<char>(input.data(), input.size()));
+  auto matched = machine.matches(std::span<char>(word.data(), word.size()));
+  auto eof     = machine.matches<true>(std::span<char>(word.data(), word.size()));
+  std::size_t count = 0;
+  for (auto const& result : machine.find_many(std::span<char>(input.data(), input.size()))) {
+    count += result.range.size() != 0;
+  }
+  ASSERT_EQ(guard.count(), 0);
+
+  ASSERT_TRUE(found.range.size() != 0);
+  ASSERT_TRUE(matched);
+  ASSERT_FALSE(eof);
+  ASSERT_EQ(count, 2);
+}
+
+TEST(allocations, utf8_find_and_errors) {
+  StateMachine<void, char32_t> machine;
+  machine.match_sequence("héllo").exit_point().optimize();
+
+  std::string input     = "xhéhéllo→";
+  std::string malformed = "h\xc3llo";
+
+  AllocationGuard guard;
+  auto found = machine.find(std::span<char>(input.data(), input.size()));
+  auto error = machine.find(std::span<char>(malformed.data(), malformed.size()));
+  auto match = machine.matches(std::span<char>(malformed.data(), malformed.size()));
+  ASSERT_EQ(guard.count(), 0) << "Neither matches nor their errors allocate";
+
+  ASSERT_FALSE(found.is_error());
+  ASSERT_TRUE(error.is_error());
+  ASSERT_TRUE(match.is_error());
+}
+
+TEST(allocations, instrumented_find) {
+  StateMachine<void, char, MatchErrorMode::Return, 0, MatchStats> machine;
+  machine.match_sequence("alpha").exit_point().optimize();
+
+  std::string input = "aalpha";
+
+  AllocationGuard guard;
+  machine.find(std::span<char>(input.data(), input.size()));
+  ASSERT_EQ(guard.count(), 0) << "Collecting statistics does not allocate";
+}
+
+TEST(allocations, count_matches) {
+  StateMachine<void, char> machine;
+  machine.match_sequence("ab").exit_point().root().match_sequence(",").exit_point().optimize();
+
+  std::string input = "ab,xab,,abab";
+
+  AllocationGuard guard;
+  auto const count = machine.count_matches(std::span<char>(input.data(), input.size()));
+  ASSERT_EQ(guard.count(), 0) << "Counting never allocates";
+
+  ASSERT_EQ(count, 7);
+}
+
+TEST(allocations, replace_all) {
+  StateMachine<void, char> machine;
+  machine.match_sequence("ab").exit_point().root().match_sequence(",").exit_point().optimize();
+
+  std::string input = "ab,xab,,abab";
+  std::string replaced;
+  replaced.reserve(64);
+
+  AllocationGuard guard;
+  machine.replace_all(std::span<char>(input.data(), input.size()), std::string_view("-"), [&](auto const& piece) {
+    replaced.append(piece.begin(), piece.end());
+  });
+  ASSERT_EQ(guard.count(), 0) << "Replacing into a reserved buffer never allocates";
+
+  ASSERT_EQ(replaced, "--x-----");
+}
+
+TEST(allocations, split) {
+  StateMachine<void, char> machine;
+  machine.match_sequence("ab").exit_point().root().match_sequence(",").exit_point().optimize();
+
+  std::string input = "ab,xab,,abab";
+
+  AllocationGuard guard;
+  std::size_t fields = 0;
+  for (auto const& field : machine.split(std::span<char>(input.data(), input.size()))) {
+    fields += field.empty();
+  }
+  ASSERT_EQ(guard.count(), 0) << "Splitting never allocates";
+
+  ASSERT_EQ(fields, 7) << "Every field but \"x\" is empty";
+}
+
+TEST(allocations, find_many) {
+  StateMachine<void, char> machine;
+  machine.match_sequence("ab").exit_point().root().match_sequence(",").exit_point().optimize();
+
+  std::string input = "ab,xab,,abab";
+
+  AllocationGuard guard;
+  std::size_t viewed = 0;
+  for (auto const& result : machine.find_many(std::span<char>(input.data(), input.size())) | std::views::take(3)) {
+    viewed += result.range.size();
+  }
+  ASSERT_EQ(guard.count(), 0) << "Iterating over the matches never allocates";
+
+  ASSERT_EQ(viewed, 5);
+}
+
+TEST(allocations, stream_matcher) {
+  StateMachine<void, char> machine;
+  machine.match_sequence("needle").exit_point().optimize();
+
+  std::string input = "hay needle haystack needl needle";
+  StreamMatcher stream(machine, 16, 4);
+  std::size_t found = 0;
+
+  AllocationGuard guard;
+  for (std::size_t i = 0; i < input.size(); i += 4) {
+    stream.feed(std::span<char const>(input.data() + i, std::min<std::size_t>(4, input.size() - i)),
+                [&](auto const&) { found++; });
+  }
+  stream.finish([&](auto const&) { found++; });
+  ASSERT_EQ(guard.count(), 0) << "Chunks within the reserved size never grow the buffer";
+
+  ASSERT_EQ(found, 2);
+}
+
+TEST(allocations, legacy_lookup) {
+  MutableRegex regex;
+  regex.match_sequence("alpha").terminal();
+  regex.optimize();
+
+  AllocationGuard guard;
+  auto matched = regex.matches("alpha");
+  auto found   = regex.find_first("an alpha");
+  ASSERT_EQ(guard.count(), 0);
+
+  ASSERT_TRUE(matched);
+  ASSERT_NE(found.begin, nullptr);
+}
+
+int main() {
+  testing::InitGoogleTest();
+  return RUN_ALL_TESTS();
+}
@@ -19,9 +19,18 @@
 /// OR OTHER DEALINGS IN THE SOFTWARE.
 ///
 
+#include "regex-backend/bit_parallel.h"
 #include "regex-backend/builder.h"
+#include "regex-backend/glob.h"
+#include "regex-backend/lazy_state_machine.h"
+#include "regex-backend/lexer.h"
+#include "regex-backend/parser.h"
 #include "regex-backend/state_machine.h"
+#include "regex-backend/stream.h"
 #include <gtest/gtest.h>
+#include <random>
+#include <regex>
+#include <tuple>
 
 using namespace regex_backend;
 
@@ -115,6 +124,1071 @@ TEST(features, match_many_optional) {
 
 }
 
+TEST(features, find_restarts_after_partial_match) {
+  StateMachine<void, char> machine;
+  machine.match_sequence("alpha").exit_point().optimize();
+
+  std::string input = "aalpha";
+  auto result       = machine.find(std::span<char>(input.data(), input.size()));
+
+  ASSERT_EQ(std::string(result.range.begin(), result.range.end()), "alpha")
+      << "A match beginning within a failed partial match is found";
+}
+
+TEST(features, find_restarts_at_end_of_input) {
+  StateMachine<size_t, char> words;
+  words.root().match_sequence("world").exit_point(0);
+  words.root().match_sequence("or").exit_point(1);
+  words.optimize();
+
+  std::string input = "hello wor";
+  auto result       = words.find(std::span<char>(input.data(), input.size()));
+  ASSERT_NE(result.val, nullptr) << "An attempt cut short by the end of the input is restarted";
+  ASSERT_EQ(*result.val, 1u);
+  ASSERT_EQ(std::string(result.range.begin(), result.range.end()), "or");
+
+  StateMachine<size_t, char> overlapping;
+  overlapping.root().match_sequence("cbbc").exit_point(0);
+  overlapping.root().match_sequence("b").exit_point(1);
+  overlapping.optimize();
+
+  input  = "cb";
+  result = overlapping.find(std::span<char>(input.data(), input.size()));
+  ASSERT_NE(result.val, nullptr);
+  ASSERT_EQ(*result.val, 1u);
+  ASSERT_EQ(overlapping.count_matches(std::span<char>(input.data(), input.size())), 1u)
+      << "find() agrees with count_matches()";
+
+  StateMachine<void, char32_t> utf8;
+  utf8.root().match_sequence("é→x").exit_point();
+  utf8.root().match_sequence("→").exit_point();
+  utf8.optimize();
+
+  input  = "é→";
+  auto u = utf8.find(std::span<char>(input.data(), input.size()));
+  ASSERT_FALSE(u.is_error());
+  ASSERT_EQ(std::string(u.range.begin(), u.range.end()), "→") << "Restarts on codepoint boundaries";
+}
+
+TEST(features, find_utf8_match_followed_by_multibyte) {
+  StateMachine<void, char32_t> machine;
+  machine.match_sequence("héllo").exit_point().optimize();
+
+  std::string input = "xhéhéllo→";
+  auto result       = machine.find(std::span<char>(input.data(), input.size()));
+
+  ASSERT_FALSE(result.is_error()) << "Stopping before a multi-byte sequence is not a truncation";
+  ASSERT_EQ(std::string(result.range.begin(), result.range.end()), "héllo") << "Restarts on codepoint boundaries";
+}
+
+TEST(features, find_ascii_machine_over_non_ascii_input) {
+  StateMachine<void, char> machine;
+  machine.match_sequence("alpha").exit_point().optimize();
+
+  std::string input = "é→alpha";
+  auto result       = machine.find(std::span<char>(input.data(), input.size()));
+
+  ASSERT_EQ(std::string(result.range.begin(), result.range.end()), "alpha") << "Bytes above 127 simply fail to match";
+}
+
+TEST(features, match_stats) {
+  StateMachine<void, char, MatchErrorMode::Return, 0, MatchStats> machine;
+  machine.match_sequence("alpha").exit_point().optimize();
+
+  std::string input = "aalpha";
+  machine.find(std::span<char>(input.data(), input.size()));
+
+  auto stats = machine.stats();
+  ASSERT_EQ(stats.restarts, 1) << "The failed partial match is restarted once";
+  ASSERT_EQ(stats.accepts, 1) << "The exit point is reached once";
+  ASSERT_EQ(stats.transitions, 6) << "One transition per matched character";
+  ASSERT_EQ(stats.state_visits.size(), machine.node_count()) << "Every state is counted";
+
+  machine.reset_stats();
+  ASSERT_EQ(machine.stats().bytes_scanned, 0) << "Counters are cleared";
+}
+
+TEST(features, relayout_by_profile) {
+  StateMachine<void, char, MatchErrorMode::Return, 0, MatchStats> machine;
+  machine.match_sequence("alpha").exit_point().root().match_sequence("zulu").exit_point().optimize();
+
+  std::string hot = "zulu zulu zulu";
+  for (size_t i = 0; i < 3; i++) {
+    machine.find(std::span<char>(hot.data() + i * 5, 4));
+  }
+  machine.relayout(machine.stats());
+
+  ASSERT_TRUE(machine.matches(std::span<char>(hot.data(), 4))) << "Matches are preserved";
+  std::string cold = "alpha";
+  ASSERT_TRUE(machine.matches(std::span<char>(cold.data(), cold.size()))) << "Cold states are preserved";
+
+  machine.reset_stats();
+  machine.matches(std::span<char>(hot.data(), 4));
+  auto visits = machine.stats().state_visits;
+  ASSERT_EQ(visits[1] + visits[2] + visits[3] + visits[4], 4) << "The hot states directly follow the root";
+}
+
+TEST(features, optimize_numbers_sequences_consecutively) {
+  StateMachine<void, char, MatchErrorMode::Return, 0, MatchStats> machine;
+  machine.match_sequence("xyz").exit_point().root().match_sequence("abc").exit_point().optimize();
+
+  std::string input = "abc";
+  machine.matches(std::span<char>(input.data(), input.size()));
+
+  auto visits = machine.stats().state_visits;
+  ASSERT_EQ(visits[1], 1) << "The first state of the lowest sequence follows the root";
+  ASSERT_EQ(visits[2], 1) << "The sequence continues in the next state";
+  ASSERT_EQ(visits[3], 1) << "The sequence ends in the following state";
+}
+
+TEST(features, optimize_merges_equal_loops) {
+  StateMachine<void, char> digit;
+  digit.match_any_of("0123456789").exit_point();
+
+  StateMachine<void, char> number;
+  number.match_many(digit).exit_point().optimize();
+  ASSERT_EQ(number.node_count(), 2) << "The root and a single looping state";
+
+  StateMachine<void, char> prefixed;
+  prefixed.match_sequence("ab").match_many_optionally(digit).exit_point().optimize();
+  ASSERT_EQ(prefixed.node_count(), 3) << "The digits loop on the state after 'b'";
+
+  StateMachine<void, char> words;
+  for (auto word : {"walking", "talking", "balking"}) {
+    words.root().match_sequence(word).exit_point();
+  }
+  words.root().optimize();
+  ASSERT_EQ(words.node_count(), 8) << "Every word shares the suffix 'alking'";
+}
+
+TEST(features, memory_usage) {
+  StateMachine<void, char> machine;
+  machine.match_any_of("abc").match_sequence("xyz").exit_point().optimize();
+
+  auto usage = machine.memory_usage();
+  ASSERT_EQ(usage.node_count, machine.node_count());
+  ASSERT_EQ(usage.nonzero_transitions, 6) << "One transition for each of a, b, c, x, y and z";
+  ASSERT_EQ(usage.byte_classes, 5) << "[abc], x, y, z and every other character";
+  ASSERT_GE(usage.total_bytes(), usage.transition_bytes + usage.value_bytes);
+
+  MutableRegex legacy;
+  legacy.match_any_of("abc").match_sequence("xyz").terminal();
+  legacy.optimize();
+  ASSERT_EQ(legacy.memory_usage().byte_classes, 5) << "The legacy machine classifies the same keys";
+}
+
+TEST(features, trace_optimize) {
+  std::vector<OptimizePassTrace> passes;
+
+  StateMachine<void, char> machine;
+  machine.trace_optimize([&](auto const& pass) {
+    passes.push_back(pass);
+  });
+  machine.match_sequence("alpha").exit_point().root().match_sequence("delta").exit_point().root().optimize();
+
+  ASSERT_EQ(passes.size(), 7) << "Every pass is reported";
+  ASSERT_STREQ(passes[1].pass, "remove_duplicates");
+  ASSERT_LT(passes[1].nodes_after, passes[1].nodes_before) << "The shared suffix is merged";
+  ASSERT_GE(passes[1].iterations, 2) << "The merge is only complete once a round removes nothing";
+  ASSERT_GT(passes[5].bytes_allocated, 0) << "remove_blanks allocates a new node table";
+}
+
+TEST(features, lazy_state_machine) {
+  StateMachine<void, char> keyword;
+  keyword.match_sequence("if").exit_point().optimize();
+  StateMachine<void, char> lower;
+  lower.match_lowercase().exit_point().optimize();
+  StateMachine<void, char> identifier;
+  identifier.match(lower).match_many_optionally(lower).exit_point().optimize();
+
+  for (size_t cache_size : {4096, 2}) {
+    LazyStateMachine<> lazy({keyword, identifier}, cache_size);
+
+    std::string input = "9 if iffy";
+    std::span<char> rest(input.data(), input.size());
+    std::vector<std::pair<std::string, size_t>> found;
+    while (true) {
+      auto result = lazy.find(rest);
+      if (!result.rule) {
+        break;
+      }
+      found.emplace_back(std::string(result.range.begin(), result.range.end()), *result.rule);
+      rest = {result.range.data() + result.range.size(), rest.data() + rest.size()};
+    }
+
+    std::vector<std::pair<std::string, size_t>> expected = {{"if", 0}, {"iffy", 1}};
+    ASSERT_EQ(found, expected) << "Longest match wins, then the first rule (cache of " << cache_size << ")";
+
+    std::string word = "iffy";
+    ASSERT_EQ(lazy.matches(std::span<char>(word.data(), word.size())), 1);
+    ASSERT_EQ(lazy.matches(std::span<char>(word.data(), 2)), 0);
+
+    if (cache_size == 2) {
+      ASSERT_GT(lazy.cache_stats().flushes, 0) << "A tiny cache is flushed";
+      ASSERT_LE(lazy.cache_stats().cached_states, 2) << "and never grows beyond its bound";
+    }
+  }
+}
+
+TEST(features, bit_parallel) {
+  // identifiers: [a-z][a-z0-9]* followed by an optional sign
+  LinearPattern identifier;
+  identifier.match_any_of("abcdefghijklmnopqrstuvwxyz")
+      .match_many_optionally("abcdefghijklmnopqrstuvwxyz0123456789")
+      .match_optionally("+-");
+
+  StateMachine<void, char> table;
+  StateMachine<void, char> tail;
+  tail.match_any_of("abcdefghijklmnopqrstuvwxyz0123456789").exit_point().optimize();
+  table.match_any_of("abcdefghijklmnopqrstuvwxyz")
+      .match_many_optionally(tail)
+      .exit_point()
+      .match_any_of("+-")
+      .exit_point()
+      .optimize();
+
+  LinearMachine linear(identifier);
+  ASSERT_STREQ(linear.engine(), "bit_parallel/64");
+
+  std::string input = "12 ab3+ -x9 ?z";
+  std::span<char> rest(input.data(), input.size());
+  while (true) {
+    auto expected = table.find(rest);
+    auto actual   = linear.find(rest);
+    ASSERT_EQ(std::string(actual.range.begin(), actual.range.end()),
+              std::string(expected.range.begin(), expected.range.end()));
+    if (actual.range.empty()) {
+      break;
+    }
+    rest = {actual.range.data() + actual.range.size(), rest.data() + rest.size()};
+  }
+
+  std::string word = "ab3-";
+  ASSERT_TRUE(linear.matches(std::span<char>(word.data(), word.size())));
+  ASSERT_TRUE(linear.matches(std::span<char>(word.data(), 3)));
+  ASSERT_FALSE(linear.matches(std::span<char>(word.data() + 2, 2)));
+
+  // patterns wider than a single word, with the optional block straddling a word boundary
+  LinearPattern wide;
+  wide.match_sequence(std::string(62, 'a')).match_optionally("b").match_optionally("c").match_sequence("d");
+  LinearMachine wide_linear(wide);
+  ASSERT_STREQ(wide_linear.engine(), "bit_parallel/256");
+  for (auto suffix : {"d", "bd", "cd", "bcd"}) {
+    std::string text = "xx" + std::string(62, 'a') + suffix + "yy";
+    auto result      = wide_linear.find(std::span<char>(text.data(), text.size()));
+    ASSERT_EQ(std::string(result.range.begin(), result.range.end()), std::string(62, 'a') + suffix);
+  }
+  std::string wrong = std::string(62, 'a') + "cbd";
+  ASSERT_FALSE(wide_linear.matches(std::span<char>(wrong.data(), wrong.size())));
+
+  // larger patterns step over as many words as they need, never through a determinized table
+  LinearPattern huge;
+  huge.match_sequence(std::string(300, 'q')).match_many("r");
+  LinearMachine huge_linear(huge);
+  ASSERT_STREQ(huge_linear.engine(), "bit_parallel/dynamic");
+  std::string text = std::string(300, 'q') + "rrr";
+  ASSERT_TRUE(huge_linear.matches(std::span<char>(text.data(), text.size())));
+  std::string noisy = "\xffq" + text + "\xfe";
+  auto found        = huge_linear.find(std::span<char>(noisy.data(), noisy.size()));
+  ASSERT_EQ(std::string(found.range.begin(), found.range.end()), text);
+
+  // optional positions, null bytes and bytes past ascii, the optional block spanning several words
+  LinearPattern bounded;
+  bounded.match_sequence(std::string(1, '\0')).match_default().match_repeat("x", 1, 300);
+  LinearMachine bounded_linear(bounded);
+  ASSERT_STREQ(bounded_linear.engine(), "bit_parallel/dynamic");
+  for (size_t n : {0, 1, 2, 63, 64, 150, 300, 301}) {
+    std::string input = std::string("\0\xff", 2) + std::string(n, 'x');
+    ASSERT_EQ(bounded_linear.matches(std::span<char>(input.data(), input.size())), n >= 1 && n <= 300) << n;
+  }
+
+  // an optional block which is followed by a required position
+  LinearPattern straddle;
+  straddle.match_sequence(std::string(120, 'a')).match_repeat("b", 0, 200).match_sequence("c");
+  LinearMachine straddle_linear(straddle);
+  for (size_t n : {0, 1, 8, 136, 200, 201}) {
+    std::string input = std::string(120, 'a') + std::string(n, 'b') + "c";
+    ASSERT_EQ(straddle_linear.matches(std::span<char>(input.data(), input.size())), n <= 200) << n;
+  }
+}
+
+TEST(features, match_repeat) {
+  StateMachine<void, char> hex;
+  hex.match_any_of("0123456789abcdef").exit_point().optimize();
+
+  StateMachine<void, char> digest;
+  digest.match_repeat(hex, 32).exit_point().optimize();
+
+  std::string input = "0123456789abcdef0123456789abcdef";
+  ASSERT_TRUE(digest.matches(std::span<char>(input.data(), 32)));
+  ASSERT_FALSE(digest.matches(std::span<char>(input.data(), 31)));
+  input += "0";
+  ASSERT_FALSE(digest.matches(std::span<char>(input.data(), 33)));
+
+  StateMachine<void, char> bounded;
+  bounded.match_sequence("#").match_repeat(hex, 2, 4).exit_point().optimize();
+  StateMachine<void, char> open;
+  open.match_repeat(hex, 3, StateMachine<void, char>::UNBOUNDED).exit_point().optimize();
+
+  LinearPattern linear_bounded;
+  linear_bounded.match_sequence("#").match_repeat("0123456789abcdef", 2, 4);
+  BitParallelMachine<> bits_bounded(linear_bounded);
+  LinearPattern linear_open;
+  linear_open.match_repeat("0123456789abcdef", 3, LinearPattern::UNBOUNDED);
+  BitParallelMachine<> bits_open(linear_open);
+
+  for (std::string s : {"#", "#a", "#ab", "#abc", "#abcd", "#abcde", "abc", "abcdef0123", "ab"}) {
+    std::span<char> text(s.data(), s.size());
+    bool const in_bounds = s.size() >= 3 && s.size() <= 5 && s[0] == '#';
+    bool const is_open   = s.size() >= 3 && s[0] != '#';
+    ASSERT_EQ((bool)bounded.matches(text), in_bounds) << s;
+    ASSERT_EQ(bits_bounded.matches(text), in_bounds) << s;
+    ASSERT_EQ((bool)open.matches(text), is_open) << s;
+    ASSERT_EQ(bits_open.matches(text), is_open) << s;
+  }
+}
+
+TEST(features, match_repeat_overlapping_suffix) {
+  StateMachine<void, char> a;
+  a.match_any_of("a").exit_point();
+
+  StateMachine<void, char> up_to_two;
+  up_to_two.match_repeat(a, 0, 2).match_any_of("a").exit_point().optimize();
+  StateMachine<void, char> many;
+  many.match_many_optionally(a).match_any_of("a").exit_point().optimize();
+  StateMachine<void, char> one_or_two;
+  one_or_two.match_repeat(a, 1, 2).match_any_of("ab").exit_point().optimize();
+
+  for (std::string s : {"", "a", "aa", "aaa", "aaaa", "ab", "aab", "aaab"}) {
+    std::span<char> text(s.data(), s.size());
+    bool const all_a = s.find('b') == std::string::npos;
+    ASSERT_EQ((bool)up_to_two.matches(text), all_a && s.size() >= 1 && s.size() <= 3) << s;
+    ASSERT_EQ((bool)many.matches(text), all_a && s.size() >= 1) << s;
+    ASSERT_EQ((bool)one_or_two.matches(text), s.size() >= 2 && s.size() <= 3 && s.find('b') >= s.size() - 1) << s;
+  }
+
+  // merging two loops over the same pattern leads back into the merged states rather than unrolling forever
+  StateMachine<void, char> bc;
+  bc.match_sequence("bc").exit_point();
+  StateMachine<void, char> loops;
+  loops.match_many_optionally(bc).match_many(bc).exit_point().optimize();
+  for (std::string s : {"", "b", "bc", "bcb", "bcbc", "bcbcbc"}) {
+    std::span<char> text(s.data(), s.size());
+    ASSERT_EQ((bool)loops.matches(text), !s.empty() && s.size() % 2 == 0) << s;
+  }
+}
+
+TEST(features, case_folding) {
+  StateMachine<void, char> exact;
+  exact.match_sequence("select").exit_point().optimize();
+
+  StateMachine<void, char> folded;
+  folded.case_folding(CaseFolding::Ascii).match_sequence("select").exit_point().optimize();
+
+  for (std::string word : {"select", "SELECT", "SeLeCt"}) {
+    ASSERT_TRUE(folded.matches(std::span<char>(word.data(), word.size()))) << word;
+  }
+  std::string other = "selext";
+  ASSERT_FALSE(folded.matches(std::span<char>(other.data(), other.size())));
+  ASSERT_EQ(folded.memory_usage().node_count, exact.memory_usage().node_count)
+      << "Every case shares the same states once optimized";
+
+  StateMachine<void, char> mixed;
+  mixed.match_sequence("id").match_sequence("_X", CaseFolding::Ascii).exit_point().optimize();
+  for (std::string word : {"id_x", "id_X"}) {
+    ASSERT_TRUE(mixed.matches(std::span<char>(word.data(), word.size()))) << word;
+  }
+  std::string upper_prefix = "ID_x";
+  ASSERT_FALSE(mixed.matches(std::span<char>(upper_prefix.data(), upper_prefix.size())));
+
+  StateMachine<void, char32_t> greek;
+  greek.match_sequence("ΣΟΦΙΑ", CaseFolding::Unicode).exit_point().optimize();
+  StateMachine<void, char32_t> greek_ascii;
+  greek_ascii.match_sequence("ΣΟΦΙΑ", CaseFolding::Ascii).exit_point().optimize();
+  for (std::string word : {"ΣΟΦΙΑ", "σοφια", "ςοΦΙα"}) {
+    ASSERT_TRUE(greek.matches(std::span<char>(word.data(), word.size()))) << word;
+  }
+  std::string lower = "σοφια";
+  ASSERT_FALSE(greek_ascii.matches(std::span<char>(lower.data(), lower.size())));
+
+  StateMachine<void, char32_t> accented;
+  accented.match_sequence("άέήίόύώϊϋ", CaseFolding::Unicode).exit_point().optimize();
+  for (std::string word : {"άέήίόύώϊϋ", "ΆΈΉΊΌΎΏΪΫ", "ΆέΉίΌύΏϊΫ"}) {
+    ASSERT_TRUE(accented.matches(std::span<char>(word.data(), word.size()))) << word;
+  }
+  std::string unaccented = "ΑΕΗΙΟΥΩΙΥ";
+  ASSERT_FALSE(accented.matches(std::span<char>(unaccented.data(), unaccented.size())));
+
+  // İ and ı only fold to one another under turkic rules, simple folding keeps them apart
+  StateMachine<void, char32_t> dotted;
+  dotted.match_sequence("İ", CaseFolding::Unicode).exit_point().optimize();
+  StateMachine<void, char32_t> dotless;
+  dotless.match_sequence("ı", CaseFolding::Unicode).exit_point().optimize();
+  std::string dotted_i = "İ", dotless_i = "ı";
+  ASSERT_TRUE(dotted.matches(std::span<char>(dotted_i.data(), dotted_i.size())));
+  ASSERT_FALSE(dotted.matches(std::span<char>(dotless_i.data(), dotless_i.size())));
+  ASSERT_FALSE(dotless.matches(std::span<char>(dotted_i.data(), dotted_i.size())));
+  std::string ij = "Ĳ";
+  StateMachine<void, char32_t> ligature;
+  ligature.match_sequence("ĳ", CaseFolding::Unicode).exit_point().optimize();
+  ASSERT_TRUE(ligature.matches(std::span<char>(ij.data(), ij.size()))) << "The pairs around them are kept";
+}
+
+TEST(features, find_captures) {
+  StateMachine<void, char> word;
+  StateMachine<void, char> lower;
+  lower.match_lowercase().exit_point().optimize();
+  word.match_many(lower).exit_point().optimize();
+
+  StateMachine<void, char> number;
+  StateMachine<void, char> digit;
+  digit.match_digit().exit_point().optimize();
+  number.match_many(digit).exit_point().optimize();
+
+  StateMachine<void, char> record;
+  record.match_sequence("user=").capture(0, word).match_sequence(" id=").capture(1, number).exit_point().optimize();
+
+  std::string input = "use user=bob id=42; user=al id=7";
+  std::span<char> rest(input.data(), input.size());
+  std::vector<std::pair<std::string, std::string>> found;
+  while (true) {
+    auto result = record.find_captures(rest);
+    if (result.match.range.empty()) {
+      break;
+    }
+    ASSERT_TRUE(result.groups[0].has_value());
+    ASSERT_TRUE(result.groups[1].has_value());
+    ASSERT_FALSE(result.groups[2].has_value()) << "Unused groups are left empty";
+    found.emplace_back(std::string(result.groups[0]->begin(), result.groups[0]->end()),
+                       std::string(result.groups[1]->begin(), result.groups[1]->end()));
+    rest = {result.match.range.data() + result.match.range.size(), rest.data() + rest.size()};
+  }
+  std::vector<std::pair<std::string, std::string>> expected = {{"bob", "42"}, {"al", "7"}};
+  ASSERT_EQ(found, expected);
+
+  // a capture spanning the whole match starts at the root
+  StateMachine<void, char> whole;
+  whole.open_capture(3).match_sequence("ab").close_capture(3).match_sequence("!").exit_point().optimize();
+  std::string text = "aaab!";
+  auto result      = whole.find_captures(std::span<char>(text.data(), text.size()));
+  ASSERT_TRUE(result.groups[3].has_value());
+  ASSERT_EQ(std::string(result.groups[3]->begin(), result.groups[3]->end()), "ab");
+
+  // a repeated group holds its last repetition
+  StateMachine<void, char> ab;
+  ab.match_sequence("ab").exit_point();
+  StateMachine<void, char> group;
+  group.capture(0, ab).exit_point();
+  StateMachine<void, char> repeated;
+  repeated.match_sequence("x").match_many(group).match_sequence("y").exit_point().optimize();
+  for (std::string input : {"xaby", "xababy", "-xabababy"}) {
+    auto repetition = repeated.find_captures(std::span<char>(input.data(), input.size()));
+    ASSERT_TRUE(repetition.groups[0].has_value()) << input;
+    ASSERT_EQ(std::string(repetition.groups[0]->begin(), repetition.groups[0]->end()), "ab") << input;
+  }
+  StateMachine<void, char> bare;
+  bare.match_many(group).exit_point().optimize();
+  std::string ababab = "ababab";
+  auto last          = bare.find_captures(std::span<char>(ababab.data(), ababab.size()));
+  ASSERT_EQ(last.match.range.size(), 6);
+  ASSERT_TRUE(last.groups[0].has_value());
+  ASSERT_EQ(std::string(last.groups[0]->begin(), last.groups[0]->end()), "ab");
+}
+
+TEST(features, stream_matcher) {
+  // keywords are only keywords when followed by a space, which is left in the stream
+  StateMachine<void, char> tokens;
+  tokens.root().match_sequence("if ").exit_point(1);
+  tokens.root().match_sequence("iffy").exit_point();
+  tokens.root().match_sequence("else").exit_point();
+  tokens.optimize();
+
+  std::string input = "if iffy elsewhere if if iff els else";
+  std::vector<std::pair<size_t, std::string>> expected;
+  std::span<char> rest(input.data(), input.size());
+  while (true) {
+    auto result = tokens.find(rest);
+    if (result.range.empty()) {
+      break;
+    }
+    expected.emplace_back(result.range.data() - input.data(), std::string(result.range.begin(), result.range.end()));
+    rest = {result.range.data() + result.range.size(), rest.data() + rest.size()};
+  }
+  ASSERT_EQ(expected.size(), 6);
+
+  for (size_t chunk : {1, 2, 3, 7, 64}) {
+    StreamMatcher stream(tokens);
+    std::vector<std::pair<size_t, std::string>> found;
+    auto const on_match = [&](auto const& match) {
+      found.emplace_back(match.offset, std::string(match.range.begin(), match.range.end()));
+    };
+    for (size_t i = 0; i < input.size(); i += chunk) {
+      stream.feed(std::span<char const>(input.data() + i, std::min(chunk, input.size() - i)), on_match);
+      ASSERT_LE(stream.buffered(), 4 + chunk) << "Only the attempt in progress is held back";
+    }
+    stream.finish(on_match);
+    ASSERT_EQ(found, expected) << "Chunks of " << chunk;
+  }
+
+  // a trailing context longer than the match is clamped rather than running before its start
+  StateMachine<void, char> context;
+  context.match_sequence("ab").exit_point(5).optimize();
+  std::string text = "xab";
+  auto result      = context.find(std::span<char>(text.data(), text.size()));
+  ASSERT_EQ(result.range.data(), text.data() + 1);
+  ASSERT_TRUE(result.range.empty());
+}
+
+TEST(features, compile_regex) {
+  auto const all = [](auto const& regex, std::string input) {
+    std::vector<std::string> found;
+    std::span<char> rest(input.data(), input.size());
+    while (true) {
+      auto result = regex.find(rest);
+      if (result.range.empty()) {
+        break;
+      }
+      found.emplace_back(result.range.begin(), result.range.end());
+      rest = {result.range.data() + result.range.size(), rest.data() + rest.size()};
+    }
+    return found;
+  };
+  auto const matches = [](auto const& regex, std::string input) {
+    return regex.matches(std::span<char>(input.data(), input.size()));
+  };
+
+  auto integer = compile_regex("[1-9][0-9]*|0");
+  ASSERT_FALSE(integer.is_error());
+  ASSERT_EQ(all(integer, "x = 120 + 0 - 07;"), (std::vector<std::string>{"120", "0", "0", "7"}));
+
+  auto repeat = compile_regex("a{2,3}(bc)?\\.x*");
+  for (auto text : {"aa.", "aaa.", "aabc.", "aaabc.xxx"}) {
+    ASSERT_TRUE(matches(repeat, text)) << text;
+  }
+  for (auto text : {"a.", "aaaa.", "aab.", "aa"}) {
+    ASSERT_FALSE(matches(repeat, text)) << text;
+  }
+
+  auto keyword = compile_regex("(?i)select|from");
+  ASSERT_EQ(all(keyword, "SELECT a FROM b"), (std::vector<std::string>{"SELECT", "FROM"}));
+
+  // a negated class excludes every case of its characters
+  auto not_a = compile_regex("(?i)[^a]");
+  ASSERT_FALSE(matches(not_a, "a"));
+  ASSERT_FALSE(matches(not_a, "A"));
+  ASSERT_TRUE(matches(not_a, "b"));
+  auto not_b = compile_regex("(?i)x[^b]y");
+  ASSERT_FALSE(matches(not_b, "xby"));
+  ASSERT_FALSE(matches(not_b, "xBy"));
+  ASSERT_TRUE(matches(not_b, "xcy"));
+  ASSERT_TRUE(matches(not_b, "XCY"));
+  auto not_word = compile_regex("(?i)\\W");
+  ASSERT_FALSE(matches(not_word, "K"));
+
+  // anchors refer to the bounds of the searched input
+  auto const first = [](auto const& regex, std::string input) {
+    auto result = regex.find(std::span<char>(input.data(), input.size()));
+    return std::string(result.range.begin(), result.range.end());
+  };
+  auto anchored = compile_regex("^ab+");
+  ASSERT_EQ(first(anchored, "abbab"), "abb");
+  ASSERT_EQ(first(anchored, "cab"), "");
+  auto at_end = compile_regex("[a-z]+$");
+  ASSERT_EQ(first(at_end, "ab1cd"), "cd");
+  ASSERT_EQ(first(at_end, "ab1"), "");
+
+  auto email = compile_regex("(\\w+)@([a-z]+)\\.com");
+  ASSERT_EQ(email.capture_count(), 2);
+  std::string address = "mail bob_1@example.com now";
+  auto captured       = email.machine().find_captures(std::span<char>(address.data(), address.size()));
+  ASSERT_EQ(std::string(captured.groups[0]->begin(), captured.groups[0]->end()), "bob_1");
+  ASSERT_EQ(std::string(captured.groups[1]->begin(), captured.groups[1]->end()), "example");
+
+  auto greek = compile_regex<StateMachine<void, char32_t>>("\\p{Greek}+");
+  ASSERT_EQ(all(greek, "sofia σοφια"), (std::vector<std::string>{"σοφια"}));
+  auto not_digit = compile_regex<StateMachine<void, char32_t>>("[^0-9]+");
+  ASSERT_EQ(all(not_digit, "12é3"), (std::vector<std::string>{"é"}));
+
+  for (auto bad : {"a(b", "a)", "*a", "[z-a]", "a{3,1}", "^a|b", "a+?", "\\q", "é"}) {
+    auto regex = compile_regex(bad);
+    ASSERT_TRUE(regex.is_error()) << bad;
+  }
+  ASSERT_EQ(compile_regex("ab(c").error_offset(), 4);
+
+  RegexCache cache;
+  auto cached = cache.get("[0-9]+");
+  auto again  = cache.get("[0-9]+");
+  ASSERT_EQ(cached, again) << "Patterns are compiled once";
+  ASSERT_EQ(cache.cache_stats().hits, 1);
+  ASSERT_EQ(cache.cache_stats().misses, 1);
+}
+
+TEST(features, compile_regex_limits) {
+  auto nested = [](size_t depth) {
+    std::string pattern;
+    for (size_t i = 0; i < depth; i++) {
+      pattern += "(?:";
+    }
+    return pattern + "a" + std::string(depth, ')');
+  };
+  ASSERT_FALSE(compile_regex(nested(Regex<>::MAX_GROUP_DEPTH)).is_error());
+  auto deep = compile_regex(nested(200000));
+  ASSERT_TRUE(deep.is_error()) << "Deep nesting is an error rather than a stack overflow";
+  ASSERT_STREQ(deep.error_message(), "Groups are nested too deeply");
+
+  ASSERT_FALSE(compile_regex("a{1000}").is_error());
+  for (auto bad : {"a{1001}", "a{2,1001}", "a{1001,}", "a{99999999999999999999999}"}) {
+    auto regex = compile_regex(bad);
+    ASSERT_STREQ(regex.error_message(), "Repetition count is too large") << bad;
+  }
+  ASSERT_STREQ(compile_regex("(?:a{1000}){1000}").error_message(), "The pattern is too large");
+
+  // the subset construction of this pattern grows exponentially with the count
+  ASSERT_FALSE(compile_regex("(a|b)*a(a|b){8}").is_error());
+  auto blowup = compile_regex("(a|b)*a(a|b){14}");
+  ASSERT_STREQ(blowup.error_message(), "The pattern determinizes into too many states");
+}
+
+TEST(features, compile_regex_against_std_regex) {
+  std::mt19937 rng(2023);
+  auto const pick = [&](size_t n) {
+    return size_t(rng() % n);
+  };
+
+  // random patterns over {a, b, c}, in the syntax shared with ECMAScript
+  auto const pattern = [&](auto& self, size_t depth) -> std::string {
+    std::string out;
+    size_t const alternatives = depth > 0 && pick(3) == 0 ? 2 : 1;
+    for (size_t alt = 0; alt < alternatives; alt++) {
+      if (alt != 0) {
+        out += "|";
+      }
+      for (size_t n = 1 + pick(depth + 1); n > 0; n--) {
+        bool const group = depth > 0 && pick(3) == 0;
+        switch (group ? 4 + pick(2) : pick(4)) {
+          case 0: out += std::string(1, "abc"[pick(3)]); break;
+          case 1: out += std::vector<std::string>{"[ab]", "[bc]", "[^a]", "[a-c]"}[pick(4)]; break;
+          case 2: out += "."; break;
+          case 3: out += std::string(1, "abc"[pick(3)]) + std::string(1, "abc"[pick(3)]); break;
+          case 4: out += "(?:" + self(self, depth - 1) + ")"; break;
+          default: out += "(" + self(self, depth - 1) + ")"; break;
+        }
+        // groups take fewer quantifiers, std::regex backtracks exponentially through nested unbounded loops
+        out += group ? std::vector<std::string>{"", "", "?", "+", "{2}"}[pick(5)]
+                     : std::vector<std::string>{"", "", "*", "+", "?", "{2}", "{0,2}", "{1,3}", "{2,}"}[pick(9)];
+      }
+    }
+    return out;
+  };
+
+  for (size_t iteration = 0; iteration < 300; iteration++) {
+    auto const text = pattern(pattern, 2);
+    auto regex      = compile_regex(text);
+    if (regex.is_error()) {
+      ASSERT_STREQ(regex.error_message(), "The pattern only matches the empty string") << text;
+      continue;
+    }
+    std::regex const reference(text, std::regex::ECMAScript);
+
+    for (size_t sample = 0; sample < 20; sample++) {
+      std::string input;
+      for (size_t n = pick(7); n > 0; n--) {
+        input.push_back("abc"[pick(3)]);
+      }
+      std::span<char> span(input.data(), input.size());
+      ASSERT_EQ(regex.matches(span), std::regex_match(input, reference))
+          << text << " on '" << input << "'";
+
+      // the leftmost, longest non-empty match
+      std::string expected;
+      for (size_t begin = 0; begin < input.size() && expected.empty(); begin++) {
+        for (size_t end = input.size(); end > begin; end--) {
+          if (std::regex_match(input.substr(begin, end - begin), reference)) {
+            expected = std::to_string(begin) + ":" + input.substr(begin, end - begin);
+            break;
+          }
+        }
+      }
+      auto const found = regex.find(span);
+      ASSERT_EQ(found.range.empty() ? "" : std::to_string(found.range.data() - input.data()) + ":" +
+                                               std::string(found.range.begin(), found.range.end()),
+                expected)
+          << text << " on '" << input << "'";
+    }
+  }
+}
+
+TEST(features, product_operations) {
+  auto const matches = [](auto const& machine, std::string input) {
+    return (bool)machine.matches(std::span<char>(input.data(), input.size()));
+  };
+
+  StateMachine<void, char> lower;
+  lower.match_lowercase().exit_point().optimize();
+  StateMachine<void, char> words;
+  words.match_many(lower).exit_point().optimize();
+
+  StateMachine<void, char> keywords;
+  keywords.root().match_sequence("if").exit_point();
+  keywords.root().match_sequence("else").exit_point();
+  keywords.root().match_sequence("IF").exit_point();
+  keywords.optimize();
+
+  StateMachine<void, char> short_words;
+  short_words.match_repeat(lower, 1, 3).exit_point().optimize();
+
+  auto const both = words.intersect(keywords);
+  auto const identifiers = words.subtract(keywords);
+  auto const short_identifiers = identifiers.intersect(short_words);
+  auto const not_keyword = keywords.complement();
+
+  for (auto [text, in_both, is_identifier, is_short] : std::vector<std::tuple<std::string, bool, bool, bool>>{
+           {"if", true, false, false},
+           {"else", true, false, false},
+           {"IF", false, false, false},
+           {"iff", false, true, true},
+           {"elsewhere", false, true, false},
+           {"x", false, true, true},
+           {"", false, false, false},
+       }) {
+    ASSERT_EQ(matches(both, text), in_both) << text;
+    ASSERT_EQ(matches(identifiers, text), is_identifier) << text;
+    ASSERT_EQ(matches(short_identifiers, text), is_short) << text;
+  }
+
+  for (std::string text : {"if", "else", "IF"}) {
+    ASSERT_FALSE(matches(not_keyword, text)) << text;
+  }
+  for (std::string text : {"", "i", "iff", "If", "else!", "x y"}) {
+    ASSERT_TRUE(matches(not_keyword, text)) << text;
+  }
+  ASSERT_TRUE(matches(not_keyword.complement(), "else"));
+  ASSERT_FALSE(matches(not_keyword.complement(), "elsa"));
+
+  // "if" is excluded but its prefix "i" is still an identifier
+  std::string input = "if elsewhere else";
+  auto result       = identifiers.find(std::span<char>(input.data(), input.size()));
+  ASSERT_EQ(std::string(result.range.begin(), result.range.end()), "i");
+}
+
+TEST(features, fuzzy_lookup) {
+  StateMachine<int, char> dictionary;
+  std::vector<std::string> const words = {"select", "insert", "update", "delete", "from", "where"};
+  for (size_t i = 0; i < words.size(); i++) {
+    dictionary.root().match_sequence(words[i]).exit_point(int(i));
+  }
+  dictionary.optimize();
+
+  auto const lookup = [&](std::string input, size_t max_edits) {
+    std::vector<std::pair<std::string, size_t>> found;
+    for (auto match : dictionary.fuzzy_lookup(std::span<char>(input.data(), input.size()), max_edits)) {
+      found.emplace_back(words[*match.value], match.distance);
+    }
+    return found;
+  };
+  using Found = std::vector<std::pair<std::string, size_t>>;
+
+  ASSERT_EQ(lookup("select", 0), (Found{{"select", 0}}));
+  ASSERT_EQ(lookup("selct", 0), Found{});
+  ASSERT_EQ(lookup("selct", 1), (Found{{"select", 1}}));
+  ASSERT_EQ(lookup("fromm", 1), (Found{{"from", 1}}));
+  ASSERT_EQ(lookup("wehre", 1), Found{}) << "a transposition is two edits";
+  ASSERT_EQ(lookup("wehre", 2), (Found{{"where", 2}}));
+  ASSERT_EQ(lookup("elete", 2), (Found{{"delete", 1}}));
+  ASSERT_EQ(lookup("", 2), Found{});
+
+  // every entry within reach is reported, the closest first
+  ASSERT_EQ(lookup("selete", 2), (Found{{"delete", 1}, {"select", 2}}));
+  ASSERT_EQ(lookup("selete", 1), (Found{{"delete", 1}}));
+
+  // utf8 sequences are single characters, and loops are followed as far as the distance allows
+  StateMachine<void, char32_t> accented;
+  StateMachine<void, char32_t> bang;
+  bang.match_sequence("!").exit_point();
+  accented.match_sequence("café").match_many_optionally(bang).exit_point().optimize();
+  for (auto [input, distance] : std::vector<std::pair<std::string, size_t>>{
+           {"café", 0}, {"cafe", 1}, {"café!!!", 0}, {"cafè!", 1}, {"caf", 1}}) {
+    auto const result = accented.fuzzy_lookup(std::span<char>(input.data(), input.size()), 2);
+    ASSERT_EQ(result.size(), 1u) << input;
+    ASSERT_EQ(result[0].distance, distance) << input;
+  }
+  std::string far = "cake";
+  ASSERT_TRUE(accented.fuzzy_lookup(std::span<char>(far.data(), far.size()), 1).empty());
+}
+
+TEST(features, glob_set) {
+  std::vector<std::string> const globs = {
+      "*.txt", "build/", "/docs/**/*.md", "src/**", "**/tmp", "a?c", "[!a-c]x", "keep.txt"};
+  auto const set = compile_globs(std::span<std::string const>(globs));
+  ASSERT_FALSE(set.is_error());
+
+  auto const winner = [&](std::string path) -> std::string {
+    auto const result = set.match(std::span<char>(path.data(), path.size()));
+    return result ? globs[*result] : "";
+  };
+
+  // globs without a '/' match at any depth, the others are anchored
+  ASSERT_EQ(winner("x/y/a.txt"), "*.txt");
+  ASSERT_EQ(winner("docs/x/y/a.md"), "/docs/**/*.md");
+  ASSERT_EQ(winner("x/docs/a.md"), "");
+  ASSERT_EQ(winner("a/tmp/f"), "**/tmp");
+  ASSERT_EQ(winner("ax"), "");
+  ASSERT_EQ(winner("d/x"), "");
+  ASSERT_EQ(winner("x/abc"), "a?c");
+
+  // directory globs only match beneath them, and the last matching glob wins
+  ASSERT_EQ(winner("build"), "");
+  ASSERT_EQ(winner("build/a"), "build/");
+  ASSERT_EQ(winner("src/build/o.o"), "src/**");
+  ASSERT_EQ(winner("keep.txt"), "keep.txt");
+  ASSERT_EQ(winner("a.txt/inner"), "*.txt");
+
+  std::vector<std::string> const malformed = {"*.md", "src/[a-"};
+  auto const error = compile_globs(std::span<std::string const>(malformed));
+  ASSERT_TRUE(error.is_error());
+  ASSERT_EQ(error.error_glob(), 1u);
+  ASSERT_EQ(error.error_offset(), 4u);
+}
+
+TEST(features, lexer) {
+  enum Kind {
+    Keyword,
+    Identifier,
+    Integer,
+    Space,
+    Assign,
+    Equals,
+    Call,
+    Comment
+  };
+
+  auto const identifier = compile_regex("[a-z_][a-z0-9_]*");
+  auto const integer    = compile_regex("[0-9]+");
+  auto const space      = compile_regex(" +");
+  auto const keyword    = compile_regex("if|else|while");
+  StateMachine<void, char> assign, equals, call, comment, line;
+  assign.match_sequence("=").exit_point();
+  equals.match_sequence("==").exit_point();
+  // a name followed by '(', leaving the parenthesis out of the token
+  call.match(identifier.machine()).match_sequence("(").exit_point(1);
+  // comments run until the end of the input
+  line.match_default().exit_point();
+  comment.match_sequence("#").match_many_optionally(line).match_eof().exit_point();
+
+  Lexer<Kind> const lexer = {{call, Call},
+                             {keyword.machine(), Keyword},
+                             {identifier.machine(), Identifier},
+                             {integer.machine(), Integer},
+                             {space.machine(), Space},
+                             {equals, Equals},
+                             {assign, Assign},
+                             {comment, Comment}};
+
+  auto const lex = [&](std::string input) {
+    std::vector<decltype(lexer)::token> tokens;
+    auto const consumed = lexer.tokenize(std::span<char>(input.data(), input.size()), tokens);
+    std::vector<std::pair<Kind, std::string>> found;
+    for (auto const& t : tokens) {
+      found.emplace_back(t.kind, std::string(t.range.begin(), t.range.end()));
+    }
+    return std::make_pair(found, consumed);
+  };
+  using Found = std::vector<std::pair<Kind, std::string>>;
+
+  // the longest token wins, then the earliest rule
+  ASSERT_EQ(lex("if iffy == 10").first,
+            (Found{{Keyword, "if"},
+                   {Space, " "},
+                   {Identifier, "iffy"},
+                   {Space, " "},
+                   {Equals, "=="},
+                   {Space, " "},
+                   {Integer, "10"}}));
+  ASSERT_EQ(lex("x=f(").first, (Found{{Identifier, "x"}, {Assign, "="}, {Call, "f"}}))
+      << "the trailing context is lexed again";
+  ASSERT_EQ(lex("a # note").first, (Found{{Identifier, "a"}, {Space, " "}, {Comment, "# note"}}));
+
+  // lexing stops at the first element starting no token
+  auto const [tokens, consumed] = lex("a = ?b");
+  ASSERT_EQ(tokens.size(), 4u);
+  ASSERT_EQ(consumed, 4u);
+}
+
+TEST(features, count_matches) {
+  StateMachine<size_t, char> words;
+  words.root().match_sequence("ab").exit_point(0);
+  words.root().match_sequence("abab").exit_point(1);
+  words.root().match_sequence("ba").exit_point(2);
+  words.root().match_sequence("b!").exit_point(3, 1);
+  words.optimize();
+
+  std::string input;
+  for (size_t i = 0; i < 200; i++) {
+    input += std::vector<std::string>{"ab", "abab", "x", "ba", "b!", "aba", "é"}[i * 7 % 11 % 7];
+  }
+  std::span<char> span(input.data(), input.size());
+
+  size_t expected = 0;
+  std::vector<size_t> by_value(4);
+  for (auto rest = span;;) {
+    auto const match = words.find(rest);
+    if (match.range.empty()) {
+      break;
+    }
+    expected++;
+    by_value[*match.val]++;
+    rest = {match.range.data() + match.range.size(), rest.data() + rest.size()};
+  }
+  ASSERT_EQ(words.count_matches(span), expected);
+  std::vector<size_t> counts(4);
+  words.count_by_value(span, counts);
+  ASSERT_EQ(counts, by_value);
+
+  // chunks are stitched back into the same counts, whatever their boundaries
+  auto const sequential = [](size_t chunks, auto&& count_chunk) {
+    for (size_t i = chunks; i-- > 0;) {
+      count_chunk(i);
+    }
+  };
+  for (size_t chunks : {1, 2, 3, 7, 64, 1000}) {
+    ASSERT_EQ(words.count_matches(span, chunks, sequential), expected) << chunks;
+    std::vector<size_t> chunked(4);
+    words.count_by_value(span, chunked, chunks, sequential);
+    ASSERT_EQ(chunked, by_value) << chunks;
+  }
+}
+
+TEST(features, replace_all) {
+  auto const card = compile_regex("[0-9]{4}( [0-9]{4}){3}");
+  auto const mail = compile_regex("[a-z]+@[a-z]+\\.com");
+  std::vector<std::pair<StateMachine<void, char> const*, size_t>> const patterns = {{&card.machine(), 0},
+                                                                                    {&mail.machine(), 1}};
+  auto const pii = StateMachine<size_t, char>::prioritized_union(
+      std::span<std::pair<StateMachine<void, char> const*, size_t> const>(patterns));
+
+  std::string input = "card 1234 5678 9012 3456, mail bob@mail.com, 12 34 ok";
+  std::span<char> span(input.data(), input.size());
+
+  std::string out;
+  out.reserve(input.size());
+  auto const append = [&](std::span<char const> piece) { out.append(piece.begin(), piece.end()); };
+  auto const label = [](auto const& match) { return std::string_view(*match.val == 0 ? "[card]" : "[mail]"); };
+  pii.replace_all(span, label, append);
+  ASSERT_EQ(out, "card [card], mail [mail], 12 34 ok");
+
+  out.clear();
+  pii.replace_all(span, "***", append);
+  ASSERT_EQ(out, "card ***, mail ***, 12 34 ok");
+
+  // the stream passes the elements between matches through, whatever the chunks
+  for (size_t chunk : {1, 2, 5, 64}) {
+    StreamMatcher stream(pii);
+    std::string streamed;
+    auto const on_match = [&](auto const& match) {
+      streamed += *pii.exit_value(match.exit_state) == 0 ? "***" : "@@@";
+    };
+    auto const on_gap   = [&](std::span<char const> piece) { streamed.append(piece.begin(), piece.end()); };
+    for (size_t i = 0; i < input.size(); i += chunk) {
+      stream.feed(std::span<char const>(input.data() + i, std::min(chunk, input.size() - i)), on_match, on_gap);
+    }
+    stream.finish(on_match, on_gap);
+    ASSERT_EQ(streamed, "card ***, mail @@@, 12 34 ok") << "Chunks of " << chunk;
+  }
+}
+
+TEST(features, split) {
+  auto const fields = [](auto const& delimiter, std::string input) {
+    std::vector<std::string> found;
+    for (auto field : delimiter.split(std::span<char>(input.data(), input.size()))) {
+      found.emplace_back(field.begin(), field.end());
+    }
+    return found;
+  };
+  using Fields = std::vector<std::string>;
+
+  auto const comma = compile_regex(" *, *");
+  ASSERT_EQ(fields(comma.machine(), "a, b ,c"), (Fields{"a", "b", "c"}));
+  ASSERT_EQ(fields(comma.machine(), ",a,,b,"), (Fields{"", "a", "", "b", ""})) << "empty fields are kept";
+  ASSERT_EQ(fields(comma.machine(), "abc"), (Fields{"abc"}));
+  ASSERT_EQ(fields(comma.machine(), ""), (Fields{""}));
+
+  // several leading bytes, and a trailing context left to the next field
+  StateMachine<void, char> sections;
+  sections.root().match_sequence("\n").exit_point();
+  sections.root().match_sequence(";#").exit_point(1);
+  sections.optimize();
+  ASSERT_EQ(fields(sections, "a\nb;#c;d"), (Fields{"a", "b", "#c;d"}));
+
+  auto const arrows = compile_regex<StateMachine<void, char32_t>>("→+");
+  ASSERT_EQ(fields(arrows.machine(), "é→→ü→"), (Fields{"é", "ü", ""}));
+
+  auto const range = comma.machine().split(std::span<char>());
+  static_assert(std::ranges::forward_range<decltype(range)>);
+  std::string input = "1,2,3,4";
+  auto const first  = comma.machine().split(std::span<char>(input.data(), input.size())) | std::views::take(2);
+  ASSERT_EQ(std::ranges::distance(first), 2);
+}
+
+TEST(features, find_many_view) {
+  StateMachine<size_t, char> words;
+  words.root().match_sequence("ab").exit_point(0);
+  words.root().match_sequence("cd").exit_point(1);
+  words.root().match_sequence("x!").exit_point(2, 2);
+  words.optimize();
+
+  std::string input = "x! ab cd x!ab";
+  auto const found  = [&](auto&& range) {
+    std::vector<std::pair<size_t, std::string>> out;
+    for (auto const& match : range) {
+      out.emplace_back(*match.val, std::string(match.range.begin(), match.range.end()));
+    }
+    return out;
+  };
+  using Found = std::vector<std::pair<size_t, std::string>>;
+
+  // matches of zero length are skipped rather than ending the search, and a match ending the input is kept
+  auto const all = words.find_many(std::span<char>(input.data(), input.size()));
+  ASSERT_EQ(found(all), (Found{{0, "ab"}, {1, "cd"}, {0, "ab"}}));
+  ASSERT_EQ(words.count_matches(std::span<char>(input.data(), input.size())), 3u);
+
+  static_assert(std::ranges::view<std::remove_cvref_t<decltype(all)>>);
+  static_assert(std::ranges::forward_range<decltype(all)>);
+  ASSERT_EQ(found(all | std::views::take(2)), (Found{{0, "ab"}, {1, "cd"}}));
+  ASSERT_EQ(found(all | std::views::filter([](auto const& match) { return *match.val == 0; })),
+            (Found{{0, "ab"}, {0, "ab"}}));
+
+  // iteration resumes from a copy of an iterator
+  auto it = all.begin();
+  ++it;
+  auto resumed = it;
+  ASSERT_EQ(std::string((*resumed).range.begin(), (*resumed).range.end()), "cd");
+  ASSERT_EQ(std::ranges::distance(resumed, all.end()), 2);
+  ASSERT_TRUE(it == resumed);
+
+  ASSERT_TRUE(words.find_many(std::span<char>()).empty());
+
+  // malformed utf8 ends the range with an error, after the matches preceding it
+  StateMachine<void, char32_t> utf8;
+  utf8.match_sequence("é").exit_point().optimize();
+  for (std::string malformed : {"é\x80é", "é\xc3"}) {
+    std::vector<std::string> results;
+    for (auto const& result : utf8.find_many(std::span<char>(malformed.data(), malformed.size()))) {
+      results.push_back(result.is_error() ? "error" : std::string(result.range.begin(), result.range.end()));
+    }
+    ASSERT_EQ(results, (std::vector<std::string>{"é", "error"}));
+  }
+
+  // the search is counted like find()
+  StateMachine<void, char, MatchErrorMode::Return, 0, MatchStats> counted;
+  counted.match_sequence("alpha").exit_point().optimize();
+  input = "aalpha";
+  ASSERT_EQ(std::ranges::distance(counted.find_many(std::span<char>(input.data(), input.size()))), 1);
+  auto stats = counted.stats();
+  ASSERT_EQ(stats.restarts, 1);
+  ASSERT_EQ(stats.accepts, 1);
+  ASSERT_EQ(stats.transitions, 6);
+}
+
 int main() {
   testing::InitGoogleTest();
   return RUN_ALL_TESTS();